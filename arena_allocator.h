@@ -0,0 +1,153 @@
+#pragma once
+
+#include<cstddef>
+#include<cstdint>
+#include<memory_resource>
+#include<new>
+
+#include"hashmap.h"
+
+// Monotonic arena. https://en.wikipedia.org/wiki/Region-based_memory_management
+// Hands out memory from large blocks by bumping a pointer and never frees individual allocations:
+// all memory is given back at once by release() or by the destructor, in O(number of blocks).
+// A map living in an arena therefore costs no free() calls on destruction and does not fragment the global heap.
+// Arena is a std::pmr::memory_resource, so it can back PmrHashMap as well as ArenaAllocator.
+// ArenaAllocator calls bump_allocate() directly, which the virtual do_allocate() forwards to.
+// Not thread-safe: every thread, or every request, is expected to own its arena.
+class Arena final : public std::pmr::memory_resource {
+  public:
+    // The size of the first block, every next block is twice as large as the previous one.
+    static constexpr size_t kDefaultBlockSize = 4096;
+
+    explicit Arena(size_t block_size = kDefaultBlockSize) : next_block_size_(block_size) {}
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena() override {
+        release();
+    }
+
+    // Frees all blocks at once. Every object allocated from the arena must already be destroyed.
+    // Time complexity: O(number of blocks).
+    void release() {
+        while (blocks_ != nullptr) {
+            Block *next = blocks_->next;
+            ::operator delete(static_cast<void*>(blocks_));
+            blocks_ = next;
+        }
+        current_ = end_ = nullptr;
+    }
+
+    // Returns the total number of bytes handed out since the last release(). O(1)
+    size_t bytes_allocated() const {
+        return bytes_allocated_;
+    }
+
+    // Hands out bytes with given alignment, a power of two, without going through a virtual call.
+    // Time complexity: O(1) amortized.
+    void *bump_allocate(size_t bytes, size_t alignment) {
+        char *start = Align(current_, alignment);
+        if (current_ == nullptr || start + bytes > end_) {
+            AllocateBlock(bytes + alignment);
+            start = Align(current_, alignment);
+        }
+        current_ = start + bytes;
+        bytes_allocated_ += bytes;
+        return start;
+    }
+
+  private:
+    // Header at the start of every block, the blocks form a singly linked list.
+    struct Block {
+        Block *next;
+    };
+
+    Block *blocks_ = nullptr;
+    char *current_ = nullptr, *end_ = nullptr;
+    size_t next_block_size_;
+    size_t bytes_allocated_ = 0;
+
+    // Time complexity: O(1) amortized.
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        return bump_allocate(bytes, alignment);
+    }
+
+    // Individual allocations are only freed all together by release().
+    // O(1)
+    void do_deallocate(void *, size_t, size_t) override {}
+
+    // O(1)
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+    // Returns the first address not less than pointer with given alignment. O(1)
+    static char *Align(char *pointer, size_t alignment) {
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(pointer);
+        return pointer + static_cast<size_t>((alignment - address % alignment) % alignment);
+    }
+
+    // Starts a new block large enough for min_bytes.
+    // Time complexity: O(1).
+    void AllocateBlock(size_t min_bytes) {
+        size_t size = next_block_size_;
+        while (size < min_bytes + sizeof(Block)) {
+            size *= 2;
+        }
+        next_block_size_ = size * 2;
+        Block *block = static_cast<Block*>(::operator new(size));
+        block->next = blocks_;
+        blocks_ = block;
+        current_ = reinterpret_cast<char*>(block) + sizeof(Block);
+        end_ = reinterpret_cast<char*>(block) + size;
+    }
+};
+
+// Allocator taking memory from an Arena.
+// Unlike std::pmr::polymorphic_allocator it allocates without a virtual call, through Arena::bump_allocate(),
+// but it is fixed to Arena.
+// deallocate() does nothing, the memory is reclaimed when the arena is released.
+template<class T>
+class ArenaAllocator {
+  public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena &arena) : arena_(&arena) {}
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}
+
+    // O(1) amortized
+    T *allocate(size_t n) {
+        return static_cast<T*>(arena_->bump_allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // O(1)
+    void deallocate(T *, size_t) {}
+
+    // O(1)
+    Arena *arena() const {
+        return arena_;
+    }
+
+    // O(1)
+    template<class U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+        return arena_ == other.arena();
+    }
+
+    // O(1)
+    template<class U>
+    bool operator!=(const ArenaAllocator<U> &other) const {
+        return arena_ != other.arena();
+    }
+
+  private:
+    Arena *arena_;
+};
+
+// HashMap allocating all of its memory from an Arena passed to the constructor.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class IndexPolicy = ChainedIndex>
+using ArenaHashMap = HashMap<KeyType, ValueType, Hash, IndexPolicy, DefaultResizePolicy, std::equal_to<KeyType>, false,
+                             ArenaAllocator<std::pair<const KeyType, ValueType>>>;
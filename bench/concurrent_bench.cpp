@@ -0,0 +1,107 @@
+// Measures throughput of ConcurrentHashMap against a HashMap behind a single global mutex
+// on a mixed workload of 90% lookups, 5% insertions and 5% erasures, with 1 to 64 threads.
+// Build: g++ -std=c++17 -O2 -pthread -I.. concurrent_bench.cpp -o concurrent_bench
+// Usage: ./concurrent_bench [operations per thread] [key range]
+#include"../concurrent_hashmap.h"
+
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<cstdio>
+#include<cstdlib>
+#include<mutex>
+#include<random>
+#include<thread>
+#include<vector>
+
+namespace {
+
+// HashMap protected by one mutex, the baseline ConcurrentHashMap is meant to replace.
+class GloballyLockedMap {
+  public:
+    bool contains(uint64_t key) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return map_.count(key) != 0;
+    }
+
+    void insert(uint64_t key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        map_.insert({key, key});
+    }
+
+    void erase(uint64_t key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        map_.erase(key);
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    HashMap<uint64_t, uint64_t> map_;
+};
+
+class ShardedMap {
+  public:
+    bool contains(uint64_t key) const {
+        return map_.contains(key);
+    }
+
+    void insert(uint64_t key) {
+        map_.insert({key, key});
+    }
+
+    void erase(uint64_t key) {
+        map_.erase(key);
+    }
+
+  private:
+    ConcurrentHashMap<uint64_t, uint64_t> map_;
+};
+
+// Returns millions of operations per second performed by all threads together.
+template<class Map>
+double RunBenchmark(size_t threads, size_t operations, uint64_t key_range) {
+    Map map;
+    for (uint64_t key = 0; key < key_range; key += 2) {
+        map.insert(key);
+    }
+    std::atomic<size_t> hits{0};
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t thread = 0; thread < threads; ++thread) {
+        workers.emplace_back([&map, &hits, operations, key_range, thread] {
+            std::mt19937_64 generator(thread);
+            size_t local_hits = 0;
+            for (size_t operation = 0; operation < operations; ++operation) {
+                uint64_t key = generator() % key_range;
+                uint64_t kind = generator() % 20;
+                if (kind == 0) {
+                    map.insert(key);
+                } else if (kind == 1) {
+                    map.erase(key);
+                } else {
+                    local_hits += map.contains(key);
+                }
+            }
+            hits += local_hits;
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(threads * operations) / elapsed.count() / 1e6;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t operations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    uint64_t key_range = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+    std::printf("%8s %16s %16s\n", "threads", "global mutex", "sharded");
+    for (size_t threads = 1; threads <= 64; threads *= 2) {
+        double global = RunBenchmark<GloballyLockedMap>(threads, operations, key_range);
+        double sharded = RunBenchmark<ShardedMap>(threads, operations, key_range);
+        std::printf("%8zu %11.2f Mop/s %11.2f Mop/s\n", threads, global, sharded);
+    }
+    return 0;
+}
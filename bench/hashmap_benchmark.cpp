@@ -0,0 +1,389 @@
+// Google Benchmark suite for HashMap and other hash maps: insert, find hit and miss, erase, operator[],
+// iteration, clear and rehash (which rebuilds the index), over int64, short and long string keys,
+// sizes from 1e2 to HASHMAP_BENCH_MAX_SIZE, with uniform and Zipf distributed lookups.
+// std::unordered_map is always compared; absl::flat_hash_map and ankerl::unordered_dense are compared
+// if HASHMAP_BENCH_HAS_ABSL and HASHMAP_BENCH_HAS_ANKERL are 1, which the CMake build sets from the packages
+// it finds, and which otherwise default to whether the headers are found.
+// Build: cmake -S . -B build && cmake --build build, see CMakeLists.txt
+// Usage: ./hashmap_benchmark --benchmark_filter='HashMap/int64/.*'
+// Benchmarks are named map/key type/distribution/operation/size. 1e8 string keys need tens of gigabytes,
+// define HASHMAP_BENCH_MAX_SIZE to a smaller power of ten on smaller machines.
+#include"../hashmap.h"
+
+#include<benchmark/benchmark.h>
+
+#include<algorithm>
+#include<cmath>
+#include<cstdint>
+#include<random>
+#include<string>
+#include<unordered_map>
+#include<vector>
+
+#ifndef HASHMAP_BENCH_HAS_ABSL
+#if __has_include(<absl/container/flat_hash_map.h>)
+#define HASHMAP_BENCH_HAS_ABSL 1
+#else
+#define HASHMAP_BENCH_HAS_ABSL 0
+#endif
+#endif
+
+#ifndef HASHMAP_BENCH_HAS_ANKERL
+#if __has_include(<ankerl/unordered_dense.h>)
+#define HASHMAP_BENCH_HAS_ANKERL 1
+#else
+#define HASHMAP_BENCH_HAS_ANKERL 0
+#endif
+#endif
+
+#if HASHMAP_BENCH_HAS_ABSL
+#include<absl/container/flat_hash_map.h>
+#endif
+
+#if HASHMAP_BENCH_HAS_ANKERL
+#include<ankerl/unordered_dense.h>
+#endif
+
+#ifndef HASHMAP_BENCH_MAX_SIZE
+#define HASHMAP_BENCH_MAX_SIZE 100000000
+#endif
+
+namespace {
+
+// Number of lookups timed per benchmark iteration, independent of the size of the map.
+constexpr size_t kLookupsPerIteration = 1 << 16;
+// Skew of the Zipf distribution, the value used by YCSB.
+constexpr double kZipfTheta = 0.99;
+
+// SplitMix64 finalizer, a bijection of 64-bit integers.
+uint64_t Mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Key generators. Key i of a size is always the same, present keys and missing keys never collide.
+struct Int64Keys {
+    static constexpr const char *kName = "int64";
+    typedef uint64_t Key;
+
+    static Key Present(uint64_t i) {
+        return Mix(2 * i);
+    }
+
+    static Key Missing(uint64_t i) {
+        return Mix(2 * i + 1);
+    }
+};
+
+// Fit the small string buffer of common standard libraries.
+struct ShortStringKeys {
+    static constexpr const char *kName = "short_string";
+    typedef std::string Key;
+
+    static Key Present(uint64_t i) {
+        return "p" + std::to_string(i);
+    }
+
+    static Key Missing(uint64_t i) {
+        return "m" + std::to_string(i);
+    }
+};
+
+// Heap allocated, with a long common prefix, as paths or URLs have.
+struct LongStringKeys {
+    static constexpr const char *kName = "long_string";
+    typedef std::string Key;
+
+    static Key Present(uint64_t i) {
+        return "/benchmark/keys/with/a/fairly/long/common/prefix/p" + std::to_string(i);
+    }
+
+    static Key Missing(uint64_t i) {
+        return "/benchmark/keys/with/a/fairly/long/common/prefix/m" + std::to_string(i);
+    }
+};
+
+// Zipf distributed ranks in [0, n). Gray et al., Quickly generating billion-record synthetic databases, 1994.
+class ZipfDistribution {
+  public:
+    explicit ZipfDistribution(uint64_t n) : n_(n) {
+        double zeta_n = 0;
+        for (uint64_t i = 1; i <= n; ++i) {
+            zeta_n += 1.0 / std::pow(static_cast<double>(i), kZipfTheta);
+        }
+        double zeta_2 = 1.0 + 1.0 / std::pow(2.0, kZipfTheta);
+        zeta_n_ = zeta_n;
+        alpha_ = 1.0 / (1.0 - kZipfTheta);
+        eta_ = (1.0 - std::pow(2.0 / static_cast<double>(n), 1.0 - kZipfTheta)) / (1.0 - zeta_2 / zeta_n);
+    }
+
+    template<class Generator>
+    uint64_t operator()(Generator &generator) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(generator);
+        double uz = u * zeta_n_;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, kZipfTheta)) {
+            return std::min<uint64_t>(1, n_ - 1);
+        }
+        double rank = static_cast<double>(n_) * std::pow(eta_ * u - eta_ + 1.0, alpha_);
+        return std::min(static_cast<uint64_t>(rank), n_ - 1);
+    }
+
+  private:
+    uint64_t n_;
+    double zeta_n_, alpha_, eta_;
+};
+
+enum class Distribution { kUniform, kZipf };
+
+const char *DistributionName(Distribution distribution) {
+    return distribution == Distribution::kUniform ? "uniform" : "zipf";
+}
+
+// Returns kLookupsPerIteration indices of present keys. Zipf ranks are scattered over the keys,
+// so that the hottest keys are not simply the ones inserted first.
+std::vector<uint64_t> MakeLookups(uint64_t n, Distribution distribution) {
+    std::mt19937_64 generator(42);
+    std::vector<uint64_t> lookups(kLookupsPerIteration);
+    if (distribution == Distribution::kUniform) {
+        std::uniform_int_distribution<uint64_t> uniform(0, n - 1);
+        for (auto &lookup : lookups) {
+            lookup = uniform(generator);
+        }
+    } else {
+        ZipfDistribution zipf(n);
+        for (auto &lookup : lookups) {
+            lookup = Mix(zipf(generator)) % n;
+        }
+    }
+    return lookups;
+}
+
+template<class Keys>
+std::vector<typename Keys::Key> MakeKeys(uint64_t n, bool present) {
+    std::vector<typename Keys::Key> keys;
+    keys.reserve(n);
+    for (uint64_t i = 0; i < n; ++i) {
+        keys.push_back(present ? Keys::Present(i) : Keys::Missing(i));
+    }
+    return keys;
+}
+
+template<class Map, class Keys>
+Map MakeMap(const std::vector<typename Keys::Key> &keys) {
+    Map map;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        map[keys[i]] = i;
+    }
+    return map;
+}
+
+template<class Map, class Keys>
+void BM_Insert(benchmark::State &state) {
+    auto keys = MakeKeys<Keys>(state.range(0), true);
+    for (auto _ : state) {
+        {
+            Map map;
+            for (size_t i = 0; i < keys.size(); ++i) {
+                map.insert({keys[i], i});
+            }
+            benchmark::DoNotOptimize(map);
+            state.PauseTiming();
+            // The map is destroyed here, outside of the timed region.
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<class Map, class Keys>
+void BM_FindHit(benchmark::State &state, Distribution distribution) {
+    auto keys = MakeKeys<Keys>(state.range(0), true);
+    Map map = MakeMap<Map, Keys>(keys);
+    std::vector<typename Keys::Key> lookups;
+    for (uint64_t index : MakeLookups(state.range(0), distribution)) {
+        lookups.push_back(keys[index]);
+    }
+    keys = {};
+    uint64_t checksum = 0;
+    for (auto _ : state) {
+        for (const auto &key : lookups) {
+            checksum += map.find(key)->second;
+        }
+    }
+    benchmark::DoNotOptimize(checksum);
+    state.SetItemsProcessed(state.iterations() * lookups.size());
+}
+
+template<class Map, class Keys>
+void BM_FindMiss(benchmark::State &state) {
+    Map map = MakeMap<Map, Keys>(MakeKeys<Keys>(state.range(0), true));
+    auto misses = MakeKeys<Keys>(std::min<uint64_t>(state.range(0), kLookupsPerIteration), false);
+    uint64_t checksum = 0;
+    for (auto _ : state) {
+        for (const auto &key : misses) {
+            checksum += map.find(key) == map.end();
+        }
+    }
+    benchmark::DoNotOptimize(checksum);
+    state.SetItemsProcessed(state.iterations() * misses.size());
+}
+
+template<class Map, class Keys>
+void BM_Erase(benchmark::State &state) {
+    auto keys = MakeKeys<Keys>(state.range(0), true);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(7));
+    for (auto _ : state) {
+        state.PauseTiming();
+        Map map = MakeMap<Map, Keys>(keys);
+        state.ResumeTiming();
+        for (const auto &key : keys) {
+            map.erase(key);
+        }
+        benchmark::DoNotOptimize(map);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Half of the accessed keys are missing, so operator[] both finds and inserts.
+template<class Map, class Keys>
+void BM_Subscript(benchmark::State &state, Distribution distribution) {
+    uint64_t n = state.range(0);
+    std::vector<typename Keys::Key> accesses;
+    for (uint64_t index : MakeLookups(2 * n, distribution)) {
+        accesses.push_back(index < n ? Keys::Present(index) : Keys::Missing(index - n));
+    }
+    auto keys = MakeKeys<Keys>(n, true);
+    for (auto _ : state) {
+        state.PauseTiming();
+        Map map = MakeMap<Map, Keys>(keys);
+        state.ResumeTiming();
+        for (const auto &key : accesses) {
+            ++map[key];
+        }
+        benchmark::DoNotOptimize(map);
+    }
+    state.SetItemsProcessed(state.iterations() * accesses.size());
+}
+
+template<class Map, class Keys>
+void BM_Iterate(benchmark::State &state) {
+    Map map = MakeMap<Map, Keys>(MakeKeys<Keys>(state.range(0), true));
+    uint64_t checksum = 0;
+    for (auto _ : state) {
+        for (const auto &element : map) {
+            checksum += element.second;
+        }
+    }
+    benchmark::DoNotOptimize(checksum);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<class Map, class Keys>
+void BM_Clear(benchmark::State &state) {
+    auto keys = MakeKeys<Keys>(state.range(0), true);
+    for (auto _ : state) {
+        state.PauseTiming();
+        Map map = MakeMap<Map, Keys>(keys);
+        state.ResumeTiming();
+        map.clear();
+        benchmark::DoNotOptimize(map);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Doubling the bucket count rebuilds the index of every map; HashMap keeps its data storage untouched.
+template<class Map, class Keys>
+void BM_Rehash(benchmark::State &state) {
+    auto keys = MakeKeys<Keys>(state.range(0), true);
+    for (auto _ : state) {
+        state.PauseTiming();
+        Map map = MakeMap<Map, Keys>(keys);
+        state.ResumeTiming();
+        map.rehash(map.bucket_count() * 2);
+        benchmark::DoNotOptimize(map);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template<class Function>
+void Register(const std::string &name, Function function) {
+    benchmark::RegisterBenchmark(name.c_str(), function)
+        ->RangeMultiplier(10)
+        ->Range(100, HASHMAP_BENCH_MAX_SIZE)
+        ->Unit(benchmark::kMicrosecond);
+}
+
+template<template<class> class MapOf, class Keys>
+void RegisterKeys(const std::string &map_name) {
+    typedef MapOf<typename Keys::Key> Map;
+    std::string prefix = map_name + "/" + Keys::kName + "/";
+    for (Distribution distribution : {Distribution::kUniform, Distribution::kZipf}) {
+        std::string name = prefix + DistributionName(distribution) + "/";
+        Register(name + "find_hit", [distribution](benchmark::State &state) {
+            BM_FindHit<Map, Keys>(state, distribution);
+        });
+        Register(name + "subscript", [distribution](benchmark::State &state) {
+            BM_Subscript<Map, Keys>(state, distribution);
+        });
+    }
+    // The remaining operations touch every key once, or none, so the distribution does not matter.
+    std::string name = prefix + DistributionName(Distribution::kUniform) + "/";
+    Register(name + "insert", BM_Insert<Map, Keys>);
+    Register(name + "find_miss", BM_FindMiss<Map, Keys>);
+    Register(name + "erase", BM_Erase<Map, Keys>);
+    Register(name + "iterate", BM_Iterate<Map, Keys>);
+    Register(name + "clear", BM_Clear<Map, Keys>);
+    Register(name + "rehash", BM_Rehash<Map, Keys>);
+}
+
+template<template<class> class MapOf>
+void RegisterMap(const std::string &map_name) {
+    RegisterKeys<MapOf, Int64Keys>(map_name);
+    RegisterKeys<MapOf, ShortStringKeys>(map_name);
+    RegisterKeys<MapOf, LongStringKeys>(map_name);
+}
+
+template<class Key>
+using DefaultHashMap = HashMap<Key, uint64_t>;
+
+template<class Key>
+using GroupProbingHashMap = HashMap<Key, uint64_t, std::hash<Key>, GroupProbingIndex>;
+
+template<class Key>
+using StdUnorderedMap = std::unordered_map<Key, uint64_t>;
+
+#if HASHMAP_BENCH_HAS_ABSL
+template<class Key>
+using AbslFlatHashMap = absl::flat_hash_map<Key, uint64_t>;
+#endif
+
+#if HASHMAP_BENCH_HAS_ANKERL
+template<class Key>
+using AnkerlUnorderedDense = ankerl::unordered_dense::map<Key, uint64_t>;
+#endif
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    RegisterMap<DefaultHashMap>("HashMap");
+    RegisterMap<GroupProbingHashMap>("HashMap_group_probing");
+    RegisterMap<StdUnorderedMap>("std_unordered_map");
+#if HASHMAP_BENCH_HAS_ABSL
+    RegisterMap<AbslFlatHashMap>("absl_flat_hash_map");
+#endif
+#if HASHMAP_BENCH_HAS_ANKERL
+    RegisterMap<AnkerlUnorderedDense>("ankerl_unordered_dense");
+#endif
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
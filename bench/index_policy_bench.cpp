@@ -0,0 +1,68 @@
+// Compares index policies of HashMap on insert, successful and unsuccessful find, and erase.
+// Build: g++ -std=c++17 -O2 -I.. index_policy_bench.cpp -o index_policy_bench
+// Usage: ./index_policy_bench [number of elements]
+#include"../hashmap.h"
+
+#include<chrono>
+#include<cstdint>
+#include<cstdio>
+#include<cstdlib>
+#include<random>
+#include<vector>
+
+namespace {
+
+// Returns milliseconds spent executing given function.
+template<class Function>
+double Measure(Function function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+template<class IndexPolicy>
+void RunBenchmark(const char *name, const std::vector<uint64_t> &keys, const std::vector<uint64_t> &misses) {
+    HashMap<uint64_t, uint64_t, std::hash<uint64_t>, IndexPolicy> map;
+    uint64_t checksum = 0;
+    double insert_ms = Measure([&] {
+        for (uint64_t key : keys) {
+            map.insert({key, key});
+        }
+    });
+    double hit_ms = Measure([&] {
+        for (uint64_t key : keys) {
+            checksum += map.find(key)->second;
+        }
+    });
+    double miss_ms = Measure([&] {
+        for (uint64_t key : misses) {
+            checksum += map.find(key) == map.end();
+        }
+    });
+    double erase_ms = Measure([&] {
+        for (uint64_t key : keys) {
+            map.erase(key);
+        }
+    });
+    std::printf("%-13s insert %9.2f ms  find hit %9.2f ms  find miss %9.2f ms  erase %9.2f ms  (checksum %llu)\n",
+                name, insert_ms, hit_ms, miss_ms, erase_ms, static_cast<unsigned long long>(checksum));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::mt19937_64 generator(42);
+    std::vector<uint64_t> keys(count), misses(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = generator() | 1;
+        misses[i] = generator() & ~uint64_t(1);
+    }
+    RunBenchmark<ChainedIndex>("chained", keys, misses);
+    RunBenchmark<RobinHoodIndex>("robin hood", keys, misses);
+    RunBenchmark<GroupProbingIndex>("group probe", keys, misses);
+    RunBenchmark<CompactRobinHoodIndex>("robin hood 32", keys, misses);
+    RunBenchmark<CompactGroupProbingIndex>("group 32", keys, misses);
+    return 0;
+}
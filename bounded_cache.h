@@ -0,0 +1,502 @@
+#pragma once
+
+#include<array>
+#include<cstdint>
+#include<functional>
+#include<mutex>
+#include<optional>
+#include<stdexcept>
+#include<utility>
+
+#include"hashmap.h"
+
+// Eviction policies. An eviction policy keeps the recency information of BoundedCache inline:
+// every entry of the dense data storage carries a Node of the policy, there is no separate list or queue.
+// node_at(position) returns the Node of the entry at given position of data storage. The policy is told:
+// - Insert(node_at, position) after an entry has been appended at position;
+// - Touch(node_at, position) after a hit on the entry at position;
+// - Remove(node_at, position) before the entry at position is erased;
+// - Move(node_at, from, to) after erasing has moved the entry stored last, at from, to the erased position to;
+// - Clear() after all entries have been erased.
+// Victim(node_at, size) returns the position of the entry to evict from a full cache of size entries.
+
+// Least recently used entry goes first. https://en.wikipedia.org/wiki/Cache_replacement_policies#LRU
+// Entries are linked into a list ordered by recency through positions stored in their nodes,
+// so every operation is O(1) and costs two positions per entry.
+class LruEviction {
+  public:
+    struct Node {
+        size_t previous = kNone, next = kNone;
+    };
+
+    // O(1)
+    template<class NodeAt>
+    void Insert(NodeAt node_at, size_t position) {
+        PushFront(node_at, position);
+    }
+
+    // O(1)
+    template<class NodeAt>
+    void Touch(NodeAt node_at, size_t position) {
+        if (position != head_) {
+            Remove(node_at, position);
+            PushFront(node_at, position);
+        }
+    }
+
+    // O(1)
+    template<class NodeAt>
+    void Remove(NodeAt node_at, size_t position) {
+        Node &node = node_at(position);
+        (node.previous == kNone ? head_ : node_at(node.previous).next) = node.next;
+        (node.next == kNone ? tail_ : node_at(node.next).previous) = node.previous;
+        node.previous = node.next = kNone;
+    }
+
+    // O(1)
+    template<class NodeAt>
+    void Move(NodeAt node_at, size_t from, size_t to) {
+        Node &node = node_at(to);
+        (node.previous == kNone ? head_ : node_at(node.previous).next) = to;
+        (node.next == kNone ? tail_ : node_at(node.next).previous) = to;
+        (void)from;
+    }
+
+    // O(1)
+    template<class NodeAt>
+    size_t Victim(NodeAt, size_t) {
+        return tail_;
+    }
+
+    // O(1)
+    void Clear() {
+        head_ = tail_ = kNone;
+    }
+
+  private:
+    static constexpr size_t kNone = static_cast<size_t>(-1);
+
+    size_t head_ = kNone, tail_ = kNone;
+
+    // O(1)
+    template<class NodeAt>
+    void PushFront(NodeAt node_at, size_t position) {
+        Node &node = node_at(position);
+        node.previous = kNone;
+        node.next = head_;
+        (head_ == kNone ? tail_ : node_at(head_).previous) = position;
+        head_ = position;
+    }
+};
+
+// Second chance replacement. https://en.wikipedia.org/wiki/Page_replacement_algorithm#Clock
+// Every entry carries a reference bit which hits set. The hand sweeps data storage, clearing set bits,
+// and evicts the first entry whose bit is already clear. Hits only write one byte, and eviction is amortized O(1),
+// as the hand never passes an entry twice without finding a victim.
+class ClockEviction {
+  public:
+    struct Node {
+        bool referenced = false;
+    };
+
+    // O(1)
+    template<class NodeAt>
+    void Insert(NodeAt node_at, size_t position) {
+        node_at(position).referenced = true;
+    }
+
+    // O(1)
+    template<class NodeAt>
+    void Touch(NodeAt node_at, size_t position) {
+        node_at(position).referenced = true;
+    }
+
+    // The reference bit moves along with the entry, and the entry moved under the hand is simply examined next.
+    // O(1)
+    template<class NodeAt>
+    void Remove(NodeAt, size_t) {}
+
+    // O(1)
+    template<class NodeAt>
+    void Move(NodeAt, size_t, size_t) {}
+
+    // Amortized O(1)
+    template<class NodeAt>
+    size_t Victim(NodeAt node_at, size_t size) {
+        for (;; ++hand_) {
+            if (hand_ >= size) {
+                hand_ = 0;
+            }
+            Node &node = node_at(hand_);
+            if (!node.referenced) {
+                return hand_;
+            }
+            node.referenced = false;
+        }
+    }
+
+    // O(1)
+    void Clear() {
+        hand_ = 0;
+    }
+
+  private:
+    size_t hand_ = 0;
+};
+
+// Cache holding at most a fixed number of entries, evicting one chosen by the eviction policy (see above)
+// to make room for a new one. Entries live in the dense data storage of a HashMap, next to the Node
+// of the eviction policy, so there is no second container and no per-entry allocation.
+// The HashMap is sized for one entry more than the capacity of the cache when it is constructed and never shrinks
+// on erase, so inserting and evicting never rebuilds the index. An insertion looks the key up only once:
+// a new entry is appended first, and if that overfills the cache, a victim among the other entries is erased,
+// which moves the new entry into its position. Eviction relies on erase moving the last entry into
+// the erased position, which the policy is told about.
+// Hits and misses of find() are counted, as are evictions.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class EvictionPolicy = ClockEviction,
+         class IndexPolicy = ChainedIndex>
+class BoundedCache {
+    typedef typename EvictionPolicy::Node Node;
+
+    struct Entry {
+        ValueType value;
+        Node node;
+
+        template<class... Args>
+        explicit Entry(std::in_place_t, Args&&... args) : value(std::forward<Args>(args)...) {}
+    };
+
+  public:
+    typedef HashMap<KeyType, Entry, Hash, IndexPolicy, LazyShrinkResizePolicy> map_type;
+
+    // Throws std::invalid_argument if capacity is 0.
+    // Time complexity: O(capacity).
+    explicit BoundedCache(size_t capacity, const Hash &hasher = Hash()) : capacity_(capacity), map_(hasher) {
+        if (capacity_ == 0) {
+            throw std::invalid_argument("BoundedCache: capacity must be positive");
+        }
+        map_.reserve(capacity_ + 1);
+    }
+
+    // Returns a pointer to the value with given key, nullptr if there is none, and counts a hit or a miss.
+    // A hit marks the entry as recently used. The pointer is invalidated by the next modification of the cache.
+    // Time complexity: amortized O(1).
+    ValueType *find(const KeyType &key) {
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        policy_.Touch(NodeAt(), Position(it));
+        return &it->second.value;
+    }
+
+    // Checks if there is an entry with given key, without counting it or marking it as used.
+    // Time complexity: amortized O(1).
+    bool contains(const KeyType &key) const {
+        return map_.count(key) != 0;
+    }
+
+    // Inserts an entry with given key and a value constructed from args, unless the key is already present,
+    // evicting an entry first if the cache is full. Returns a pointer to the value and whether the insertion took place.
+    // An existing entry is marked as recently used. Does not count hits or misses.
+    // Time complexity: amortized O(1).
+    template<class K, class... Args>
+    std::pair<ValueType*, bool> try_emplace(K &&key, Args&&... args) {
+        auto result = Emplace(std::forward<K>(key), std::forward<Args>(args)...);
+        return {&result.first->second.value, result.second};
+    }
+
+    // Assigns value to the entry with given key, or inserts a new entry as try_emplace() does.
+    // Returns whether the insertion took place.
+    // Time complexity: amortized O(1).
+    template<class K, class V>
+    bool insert_or_assign(K &&key, V &&value) {
+        // An existing entry leaves value untouched, so it can still be assigned.
+        auto result = Emplace(std::forward<K>(key), std::forward<V>(value));
+        if (!result.second) {
+            result.first->second.value = std::forward<V>(value);
+        }
+        return result.second;
+    }
+
+    // Erases the entry with given key. Returns whether there was one.
+    // Time complexity: amortized O(1).
+    bool erase(const KeyType &key) {
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            return false;
+        }
+        EraseAt(Position(it));
+        return true;
+    }
+
+    // Erases all entries, keeping the capacity and the counters.
+    // Time complexity: O(n + capacity).
+    void clear() {
+        map_.clear();
+        map_.reserve(capacity_ + 1);
+        policy_.Clear();
+    }
+
+    // O(1)
+    size_t size() const {
+        return map_.size();
+    }
+
+    // O(1)
+    bool empty() const {
+        return map_.empty();
+    }
+
+    // Returns the maximum number of entries. O(1)
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    // O(1)
+    size_t hits() const {
+        return hits_;
+    }
+
+    // O(1)
+    size_t misses() const {
+        return misses_;
+    }
+
+    // O(1)
+    size_t evictions() const {
+        return evictions_;
+    }
+
+  private:
+    size_t capacity_;
+    size_t hits_ = 0, misses_ = 0, evictions_ = 0;
+    map_type map_;
+    EvictionPolicy policy_;
+
+    // O(1)
+    size_t Position(typename map_type::iterator it) {
+        return static_cast<size_t>(it - map_.begin());
+    }
+
+    // Returns a function giving the Node of the entry at given position of data storage.
+    auto NodeAt() {
+        return [this](size_t position) -> Node& {
+            return map_.begin()[position].second.node;
+        };
+    }
+
+    // Helper function for try_emplace() and insert_or_assign(). Inserts an entry with given key and a value
+    // constructed from args with a single lookup, unless the key is already present, in which case the entry
+    // is marked as recently used and args are not touched. If the new entry overfills the cache,
+    // a victim is evicted and the new entry takes its position.
+    // Returns an iterator to the entry and whether the insertion took place.
+    // Time complexity: amortized O(1).
+    template<class K, class... Args>
+    std::pair<typename map_type::iterator, bool> Emplace(K &&key, Args&&... args) {
+        auto result = map_.try_emplace(std::forward<K>(key), std::in_place, std::forward<Args>(args)...);
+        size_t position = Position(result.first);
+        if (!result.second) {
+            policy_.Touch(NodeAt(), position);
+            return result;
+        }
+        if (map_.size() > capacity_) {
+            // The policy does not know the new entry yet, so the victim is one of the first capacity_ entries,
+            // and erasing it moves the new entry, stored last, into its position.
+            position = policy_.Victim(NodeAt(), capacity_);
+            policy_.Remove(NodeAt(), position);
+            map_.erase(map_.begin() + position);
+            ++evictions_;
+        }
+        policy_.Insert(NodeAt(), position);
+        return {map_.begin() + position, true};
+    }
+
+    // Erases the entry at given position, the entry stored last takes its place.
+    // Time complexity: amortized O(1).
+    void EraseAt(size_t position) {
+        policy_.Remove(NodeAt(), position);
+        size_t last_position = map_.size() - 1;
+        map_.erase(map_.begin() + position);
+        if (position != last_position) {
+            policy_.Move(NodeAt(), last_position, position);
+        }
+    }
+};
+
+// Thread-safe BoundedCache split into kShardCount independent shards, each holding an equal part of the capacity.
+// Every key belongs to the shard selected by the highest bits of its mixed hash, as in ConcurrentHashMap.
+// Hits update the recency information, so every operation locks its shard exclusively.
+// Eviction works per shard, so the cache as a whole only approximates the eviction policy.
+// References into the cache would outlive the lock, so find() returns a copy of the value
+// and in-place access goes through visit(), which runs a function while the shard is locked.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class EvictionPolicy = ClockEviction,
+         class IndexPolicy = ChainedIndex, size_t kShardCount = 16>
+class ShardedBoundedCache {
+  public:
+    typedef BoundedCache<KeyType, ValueType, Hash, EvictionPolicy, IndexPolicy> shard_type;
+
+    static_assert(kShardCount > 0 && (kShardCount & (kShardCount - 1)) == 0, "shard count must be a power of two");
+
+    // Every shard holds capacity / kShardCount entries, rounded up.
+    // Throws std::invalid_argument if capacity is 0.
+    // Time complexity: O(capacity + kShardCount).
+    explicit ShardedBoundedCache(size_t capacity, const Hash &hasher = Hash())
+        : shards_(MakeShards(capacity, hasher, std::make_index_sequence<kShardCount>())), hasher_(hasher) {}
+
+    ShardedBoundedCache(const ShardedBoundedCache &) = delete;
+    ShardedBoundedCache &operator=(const ShardedBoundedCache &) = delete;
+
+    // Returns a copy of the value with given key, std::nullopt if there is none, and counts a hit or a miss.
+    // Time complexity: amortized O(1).
+    std::optional<ValueType> find(const KeyType &key) {
+        Shard &shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const ValueType *value = shard.cache.find(key);
+        if (value == nullptr) {
+            return std::nullopt;
+        }
+        return *value;
+    }
+
+    // Calls function(value) for the entry with given key while its shard is locked, counting a hit or a miss,
+    // so the value may be modified in place. Returns whether there was such an entry.
+    // The function must not access the cache.
+    // Time complexity: amortized O(1) plus the time of the function.
+    template<class Function>
+    bool visit(const KeyType &key, Function function) {
+        Shard &shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        ValueType *value = shard.cache.find(key);
+        if (value == nullptr) {
+            return false;
+        }
+        function(*value);
+        return true;
+    }
+
+    // Checks if there is an entry with given key, without counting it or marking it as used.
+    // Time complexity: amortized O(1).
+    bool contains(const KeyType &key) const {
+        const Shard &shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.cache.contains(key);
+    }
+
+    // Inserts an entry with given key and a value constructed from args, unless the key is already present.
+    // Returns whether the insertion took place.
+    // Time complexity: amortized O(1).
+    template<class K, class... Args>
+    bool try_emplace(K &&key, Args&&... args) {
+        Shard &shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.cache.try_emplace(std::forward<K>(key), std::forward<Args>(args)...).second;
+    }
+
+    // Assigns value to the entry with given key, or inserts a new entry. Returns whether the insertion took place.
+    // Time complexity: amortized O(1).
+    template<class K, class V>
+    bool insert_or_assign(K &&key, V &&value) {
+        Shard &shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.cache.insert_or_assign(std::forward<K>(key), std::forward<V>(value));
+    }
+
+    // Erases the entry with given key. Returns whether there was one.
+    // Time complexity: amortized O(1).
+    bool erase(const KeyType &key) {
+        Shard &shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.cache.erase(key);
+    }
+
+    // Erases all entries, keeping the counters.
+    // Time complexity: O(n + capacity).
+    void clear() {
+        for (Shard &shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.cache.clear();
+        }
+    }
+
+    // Returns the number of entries. Shards are counted one after another,
+    // so under concurrent modification the result, like those of the counters below, is only approximate.
+    // Time complexity: O(kShardCount).
+    size_t size() const {
+        return Sum(&shard_type::size);
+    }
+
+    // Time complexity: O(kShardCount).
+    size_t capacity() const {
+        return shards_[0].cache.capacity() * kShardCount;
+    }
+
+    // Time complexity: O(kShardCount).
+    size_t hits() const {
+        return Sum(&shard_type::hits);
+    }
+
+    // Time complexity: O(kShardCount).
+    size_t misses() const {
+        return Sum(&shard_type::misses);
+    }
+
+    // Time complexity: O(kShardCount).
+    size_t evictions() const {
+        return Sum(&shard_type::evictions);
+    }
+
+    // O(1)
+    static constexpr size_t shard_count() {
+        return kShardCount;
+    }
+
+  private:
+    // Shards are kept on separate cache lines so that locking one does not invalidate its neighbours.
+    struct alignas(64) Shard {
+        Shard(size_t capacity, const Hash &hasher) : cache(capacity, hasher) {}
+
+        mutable std::mutex mutex;
+        shard_type cache;
+    };
+
+    static constexpr ShardMapping kShardMapping{kShardCount};
+
+    std::array<Shard, kShardCount> shards_;
+    Hash hasher_;
+
+    // Shards have no default constructor, so the array is built from an index sequence.
+    template<size_t... kIndices>
+    static std::array<Shard, kShardCount> MakeShards(size_t capacity, const Hash &hasher,
+                                                     std::index_sequence<kIndices...>) {
+        size_t shard_capacity = (capacity + kShardCount - 1) / kShardCount;
+        return {{((void)kIndices, Shard(shard_capacity, hasher))...}};
+    }
+
+    // Adds up a counter of all shards, locking one shard at a time.
+    // Time complexity: O(kShardCount).
+    size_t Sum(size_t (shard_type::*counter)() const) const {
+        size_t total = 0;
+        for (const Shard &shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += (shard.cache.*counter)();
+        }
+        return total;
+    }
+
+    // Returns the shard a key belongs to, see ShardMapping.
+    // Time complexity: O(1).
+    size_t ShardIndex(const KeyType &key) const {
+        return kShardMapping.ShardOf(static_cast<uint64_t>(hasher_(key)));
+    }
+
+    Shard &GetShard(const KeyType &key) {
+        return shards_[ShardIndex(key)];
+    }
+
+    const Shard &GetShard(const KeyType &key) const {
+        return shards_[ShardIndex(key)];
+    }
+};
@@ -0,0 +1,380 @@
+#pragma once
+
+#include<array>
+#include<atomic>
+#include<cstdint>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<optional>
+#include<shared_mutex>
+#include<thread>
+
+#include"hashmap.h"
+
+// Thread-safe HashMap split into kShardCount independent shards. https://en.wikipedia.org/wiki/Lock_striping
+// Every key belongs to the shard selected by the highest bits of its mixed hash, and every shard is a HashMap
+// guarded by its own std::shared_mutex: lookups take it shared, modifications take it exclusively.
+// Operations on keys of different shards never contend, and shards are aligned to separate cache lines.
+// References into the map would outlive the lock, so find() returns a copy of the value
+// and in-place access goes through visit(), which runs a function while the shard is locked.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class IndexPolicy = ChainedIndex,
+         size_t kShardCount = 64>
+class ConcurrentHashMap {
+  public:
+    typedef HashMap<KeyType, ValueType, Hash, IndexPolicy> shard_type;
+
+    static_assert(kShardCount > 0 && (kShardCount & (kShardCount - 1)) == 0, "shard count must be a power of two");
+
+    explicit ConcurrentHashMap(const Hash &hasher = Hash()) : hasher_(hasher) {
+        for (Shard &shard : shards_) {
+            shard.map = shard_type(hasher);
+        }
+    }
+
+    ConcurrentHashMap(const ConcurrentHashMap &) = delete;
+    ConcurrentHashMap &operator=(const ConcurrentHashMap &) = delete;
+
+    // Returns a copy of the value with given key, std::nullopt if there is none.
+    // Time complexity: amortized O(1).
+    std::optional<ValueType> find(const KeyType &key) const {
+        const Shard &shard = GetShard(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    // Checks if there is an element with given key.
+    // Time complexity: amortized O(1).
+    bool contains(const KeyType &key) const {
+        const Shard &shard = GetShard(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.count(key) != 0;
+    }
+
+    // Inserts an element in case there does not already exist one with the same key.
+    // Returns whether the insertion took place.
+    // Time complexity: amortized O(1), individual query O(n / kShardCount).
+    bool insert(const std::pair<KeyType, ValueType> &element) {
+        return try_emplace(element.first, element.second);
+    }
+
+    // Same as above, but moves the element into the map.
+    // Time complexity: amortized O(1), individual query O(n / kShardCount).
+    bool insert(std::pair<KeyType, ValueType> &&element) {
+        return try_emplace(std::move(element.first), std::move(element.second));
+    }
+
+    // Inserts an element with given key and a value constructed from args, unless the key is already present.
+    // Returns whether the insertion took place.
+    // Time complexity: amortized O(1), individual query O(n / kShardCount).
+    template<class K, class... Args>
+    bool try_emplace(K &&key, Args&&... args) {
+        Shard &shard = GetShard(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.try_emplace(std::forward<K>(key), std::forward<Args>(args)...).second;
+    }
+
+    // Assigns value to the element with given key, or inserts a new element if there is none.
+    // Returns whether the insertion took place.
+    // Time complexity: amortized O(1), individual query O(n / kShardCount).
+    template<class K, class V>
+    bool insert_or_assign(K &&key, V &&value) {
+        Shard &shard = GetShard(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        return shard.map.insert_or_assign(std::forward<K>(key), std::forward<V>(value)).second;
+    }
+
+    // Erases the element with given key. Returns whether there was one.
+    // Time complexity: amortized O(1), individual query O(n / kShardCount).
+    bool erase(const KeyType &key) {
+        Shard &shard = GetShard(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        shard.map.erase(it);
+        return true;
+    }
+
+    // Calls function(value) for the element with given key while its shard is locked exclusively,
+    // so the value may be modified in place. Returns whether there was such an element.
+    // The function must not access the map.
+    // Time complexity: amortized O(1) plus the time of the function.
+    template<class Function>
+    bool visit(const KeyType &key, Function function) {
+        Shard &shard = GetShard(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        function(it->second);
+        return true;
+    }
+
+    // Same as above, but the shard is locked shared and the function receives a constant reference.
+    // Time complexity: amortized O(1) plus the time of the function.
+    template<class Function>
+    bool visit(const KeyType &key, Function function) const {
+        const Shard &shard = GetShard(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        function(it->second);
+        return true;
+    }
+
+    // Calls function(shard) for every shard in turn, holding the lock of one shard at a time.
+    // The function receives the HashMap of the shard and must not access the map.
+    // Time complexity: O(kShardCount) plus the time of the function.
+    template<class Function>
+    void for_each_shard(Function function) {
+        for (Shard &shard : shards_) {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            function(shard.map);
+        }
+    }
+
+    // Same as above, but shards are locked shared and the function receives constant references.
+    // Time complexity: O(kShardCount) plus the time of the function.
+    template<class Function>
+    void for_each_shard(Function function) const {
+        for (const Shard &shard : shards_) {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            function(shard.map);
+        }
+    }
+
+    // Returns the number of elements. Shards are counted one after another,
+    // so under concurrent modification the result is only approximate.
+    // Time complexity: O(kShardCount).
+    size_t size() const {
+        size_t total = 0;
+        for_each_shard([&total](const shard_type &map) {
+            total += map.size();
+        });
+        return total;
+    }
+
+    // Erases all elements.
+    // Time complexity: O(n + kShardCount).
+    void clear() {
+        for_each_shard([](shard_type &map) {
+            map.clear();
+        });
+    }
+
+    // O(1)
+    static constexpr size_t shard_count() {
+        return kShardCount;
+    }
+
+  private:
+    // Shards are kept on separate cache lines so that locking one does not invalidate its neighbours.
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        shard_type map;
+    };
+
+    static constexpr ShardMapping kShardMapping{kShardCount};
+
+    std::array<Shard, kShardCount> shards_;
+    Hash hasher_;
+
+    // Returns the shard a key belongs to, see ShardMapping.
+    // Time complexity: O(1).
+    template<class K>
+    size_t ShardIndex(const K &key) const {
+        return kShardMapping.ShardOf(static_cast<uint64_t>(hasher_(key)));
+    }
+
+    template<class K>
+    Shard &GetShard(const K &key) {
+        return shards_[ShardIndex(key)];
+    }
+
+    template<class K>
+    const Shard &GetShard(const K &key) const {
+        return shards_[ShardIndex(key)];
+    }
+};
+
+// HashMap for read-mostly workloads, whose lookups take no locks. https://en.wikipedia.org/wiki/Read-copy-update
+// Readers load the current version of the map through an atomic pointer and only announce themselves
+// in one of two counters of the current epoch, so a lookup is a handful of atomic operations and never waits.
+// Writers are serialized by a mutex. Every modification copies the current version, changes the copy (including
+// any rebuild it triggers) while readers keep using the old version, publishes the copy atomically,
+// and then waits for a grace period: the epoch is flipped twice, and after each flip the readers
+// that are still counted in the previous epoch are waited for. Only then is the old version destroyed.
+// A modification costs O(n), so several of them should be batched with update().
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class IndexPolicy = ChainedIndex>
+class ReadMostlyHashMap {
+  public:
+    typedef HashMap<KeyType, ValueType, Hash, IndexPolicy> map_type;
+
+    explicit ReadMostlyHashMap(const Hash &hasher = Hash()) : current_(new map_type(hasher)) {}
+
+    ReadMostlyHashMap(const ReadMostlyHashMap &) = delete;
+    ReadMostlyHashMap &operator=(const ReadMostlyHashMap &) = delete;
+
+    ~ReadMostlyHashMap() {
+        delete current_.load();
+    }
+
+    // Returns a copy of the value with given key, std::nullopt if there is none. Takes no locks.
+    // Time complexity: amortized O(1).
+    std::optional<ValueType> find(const KeyType &key) const {
+        ReadSection section(*this);
+        auto it = section.map().find(key);
+        if (it == section.map().end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    // Checks if there is an element with given key. Takes no locks.
+    // Time complexity: amortized O(1).
+    bool contains(const KeyType &key) const {
+        ReadSection section(*this);
+        return section.map().count(key) != 0;
+    }
+
+    // Calls function(value) for the element with given key, if any, and returns whether there was one.
+    // The version read stays alive until the function returns. Takes no locks.
+    // Time complexity: amortized O(1) plus the time of the function.
+    template<class Function>
+    bool visit(const KeyType &key, Function function) const {
+        ReadSection section(*this);
+        auto it = section.map().find(key);
+        if (it == section.map().end()) {
+            return false;
+        }
+        function(it->second);
+        return true;
+    }
+
+    // Calls function(map) for a consistent snapshot of the whole map. Takes no locks.
+    // Writers publishing in the meantime wait for the function, so it should be short.
+    // Time complexity: the time of the function.
+    template<class Function>
+    void read(Function function) const {
+        ReadSection section(*this);
+        function(section.map());
+    }
+
+    // Returns the number of elements of the current version. Takes no locks. O(1)
+    size_t size() const {
+        ReadSection section(*this);
+        return section.map().size();
+    }
+
+    // Applies function(map) to a copy of the current version and publishes the result.
+    // All modifications made by one call become visible to readers at once.
+    // Time complexity: O(n) plus the time of the function and of the grace period.
+    template<class Function>
+    void update(Function function) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        std::unique_ptr<map_type> next(new map_type(*current_.load()));
+        function(*next);
+        std::unique_ptr<const map_type> previous(current_.exchange(next.release()));
+        WaitForReaders();
+    }
+
+    // Inserts an element in case there does not already exist one with the same key.
+    // Time complexity: O(n).
+    void insert(const std::pair<KeyType, ValueType> &element) {
+        update([&element](map_type &map) {
+            map.insert(element);
+        });
+    }
+
+    // Assigns value to the element with given key, or inserts a new element if there is none.
+    // Time complexity: O(n).
+    void insert_or_assign(const KeyType &key, const ValueType &value) {
+        update([&key, &value](map_type &map) {
+            map.insert_or_assign(key, value);
+        });
+    }
+
+    // Erases the element with given key if there is one.
+    // Time complexity: O(n).
+    void erase(const KeyType &key) {
+        update([&key](map_type &map) {
+            map.erase(key);
+        });
+    }
+
+  private:
+    // Number of counters per epoch. Readers of different threads mostly use different counters,
+    // so that they do not contend on a single cache line.
+    static constexpr size_t kReaderSlots = 16;
+
+    struct alignas(64) ReaderCounter {
+        std::atomic<size_t> readers{0};
+    };
+
+    // Announces a reader for its lifetime and gives it the version that was current when it started.
+    class ReadSection {
+      public:
+        explicit ReadSection(const ReadMostlyHashMap &owner) {
+            counter_ = &owner.counters_[owner.epoch_.load() & 1][ReaderSlot()].readers;
+            counter_->fetch_add(1);
+            map_ = owner.current_.load();
+        }
+
+        ReadSection(const ReadSection &) = delete;
+        ReadSection &operator=(const ReadSection &) = delete;
+
+        ~ReadSection() {
+            counter_->fetch_sub(1);
+        }
+
+        const map_type &map() const {
+            return *map_;
+        }
+
+      private:
+        std::atomic<size_t> *counter_;
+        const map_type *map_;
+    };
+
+    std::atomic<map_type*> current_;
+    std::atomic<size_t> epoch_{0};
+    mutable std::array<std::array<ReaderCounter, kReaderSlots>, 2> counters_;
+    std::mutex writer_mutex_;
+
+    // Returns the counter slot used by the calling thread. O(1)
+    static size_t ReaderSlot() {
+        static thread_local size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % kReaderSlots;
+        return slot;
+    }
+
+    // Waits until every reader which could have loaded the previous version has finished.
+    // A reader counted in an epoch after its flip loads the pointer only after it has been replaced,
+    // hence draining both epochs once after the replacement is enough.
+    // Time complexity: the duration of the longest read section in progress.
+    void WaitForReaders() {
+        for (int flip = 0; flip < 2; ++flip) {
+            size_t previous_epoch = epoch_.fetch_add(1) & 1;
+            while (CountReaders(previous_epoch) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // O(kReaderSlots)
+    size_t CountReaders(size_t epoch) const {
+        size_t readers = 0;
+        for (const ReaderCounter &counter : counters_[epoch]) {
+            readers += counter.readers.load();
+        }
+        return readers;
+    }
+};
@@ -1,279 +1,3110 @@
+#pragma once
+
+#include<algorithm>
+#include<chrono>
+#include<cstdint>
+#include<cstring>
+#include<exception>
+#include<functional>
+#include<initializer_list>
+#include<istream>
+#include<iterator>
+#include<limits>
 #include<list>
+#include<memory>
+#include<memory_resource>
+#include<optional>
+#include<ostream>
+#include<random>
 #include<stdexcept>
+#include<string>
+#include<string_view>
+#include<thread>
+#include<tuple>
+#include<type_traits>
+#include<utility>
 #include<vector>
 
-template<class KeyType, class ValueType> class Iter;
-template<class KeyType, class ValueType> class ConstIter;
+#if defined(__AVX2__)
+#include<immintrin.h>
+#elif defined(__SSE2__)
+#include<emmintrin.h>
+#endif
 
-// HashMap with separate chaining. https://en.wikipedia.org/wiki/Hash_table#Separate_chaining
-// Operates using two containers:
-// - the chain list, where chains are implemented with std::list<> and contain indices of data entries in main storage;
-// - the main data storage, implemented with std::vector<std::pair<>>.
-// Resize policy:
-// - if the number of elements exceeds current capacity multiplied by kMaxLoadFactor,
-// capacity is increased to kScalingFactor times the original;
-// - if the capacity exceeds kMinScalingFactor times the number of elements, the size is reduced kScalingFactor-fold.
+template<class KeyType, class ValueType, class StorageIterator> class Iter;
+template<class KeyType, class ValueType, class StorageConstIterator> class ConstIter;
+template<class KeyType, class ValueType, class StorageIterator> class SparseIter;
 
-template<class KeyType, class ValueType, class Hash = std::hash<KeyType> >
-class HashMap {
+// Bucket mapping policies.
+// A bucket mapping reduces a hash to the range of slots (chains, groups) of an index:
+// - RoundBucketCount(n) returns the smallest supported bucket count not less than n;
+// - Reset(bucket_count) prepares the mapping for a bucket count returned by RoundBucketCount();
+// - Bucket(hash) returns a bucket in [0, bucket_count).
+
+// Reduces hashes with the modulo operation. Supports any bucket count, but costs a 64-bit division per operation.
+class ModuloBucketMapping {
   public:
-    typedef Iter<KeyType, ValueType> iterator;
-    typedef ConstIter<KeyType, ValueType> const_iterator;
-    
-    // How many times the capacity of the map changes after rebuilding.
-    static constexpr size_t kScalingFactor = 2;
-    // The minimum discrepancies between hashmap capacity and number of stored elements for it to be rebuilt.
-    static constexpr size_t kMinLoadFactor = 4;
-    static constexpr size_t kMaxLoadFactor = 2;
-  
-    HashMap(const Hash &hasher = Hash()) : hasher_(hasher) {}
+    // O(1)
+    static size_t RoundBucketCount(size_t n) {
+        return n > 0 ? n : 1;
+    }
 
-    // Constructor from two iterators.
-    template<class Iterator>
-    HashMap(Iterator first, Iterator last, const Hash &h = Hash()) {
-        hasher_ = h;
-        while (first != last) {
-            insert(*first);
-            ++first;
-        };
-    };
+    // O(1)
+    void Reset(size_t bucket_count) {
+        bucket_count_ = bucket_count;
+    }
 
-    // Constructor from initializer list.
-    HashMap(std::initializer_list<std::pair<KeyType, ValueType>> init_list, const Hash &h = Hash()) {
-        hasher_ = h;
-        for (const auto &element : init_list) {
-            insert(element);
+    // O(1)
+    size_t Bucket(size_t hash) const {
+        return hash % bucket_count_;
+    }
+
+  private:
+    size_t bucket_count_ = 1;
+};
+
+// Returns the smallest power of two not less than n.
+// Time complexity: O(log(n)).
+constexpr size_t NextPowerOfTwo(size_t n) {
+    size_t power = 1;
+    while (power < n) {
+        power *= 2;
+    }
+    return power;
+}
+
+// Keeps the lowest bits of hashes. Bucket counts are powers of two.
+// The cheapest mapping, but only suitable for hashes whose lower bits are well distributed.
+class MaskBucketMapping {
+  public:
+    // O(log(n))
+    static size_t RoundBucketCount(size_t n) {
+        return NextPowerOfTwo(n);
+    }
+
+    // O(1)
+    void Reset(size_t bucket_count) {
+        mask_ = bucket_count - 1;
+    }
+
+    // O(1)
+    size_t Bucket(size_t hash) const {
+        return hash & mask_;
+    }
+
+  private:
+    size_t mask_ = 0;
+};
+
+// Fibonacci hashing. https://en.wikipedia.org/wiki/Hash_function#Fibonacci_hashing
+// Multiplies hashes by 2^64 / golden ratio and keeps the highest bits of the product. Bucket counts are powers of two.
+// Every bit of the hash affects the bucket, so identity hashes of sequential integers are spread over the whole index.
+class FibonacciBucketMapping {
+  public:
+    // O(log(n))
+    static size_t RoundBucketCount(size_t n) {
+        return NextPowerOfTwo(n);
+    }
+
+    // O(log(bucket_count))
+    void Reset(size_t bucket_count) {
+        size_t bits = 0;
+        while ((static_cast<size_t>(1) << bits) < bucket_count) {
+            ++bits;
+        }
+        // A shift by the full width is undefined, so a single bucket is handled by the mask.
+        shift_ = bits == 0 ? kWidth - 1 : kWidth - bits;
+        mask_ = bucket_count - 1;
+    }
+
+    // O(1)
+    size_t Bucket(size_t hash) const {
+        return ((hash * kMultiplier) >> shift_) & mask_;
+    }
+
+  private:
+    static constexpr size_t kWidth = sizeof(size_t) * 8;
+    static constexpr size_t kMultiplier =
+        sizeof(size_t) == 8 ? static_cast<size_t>(11400714819323198485ull) : static_cast<size_t>(2654435769u);
+
+    size_t shift_ = kWidth - 1, mask_ = 0;
+};
+
+// Prime bucket counts with division-free reduction. https://arxiv.org/abs/1902.01961
+// A prime bucket count spreads even hashes with regular patterns. Instead of a division,
+// hashes are folded to 32 bits and reduced with a precomputed 64-bit reciprocal of the bucket count.
+// Bucket counts are primes close to powers of two, up to 4294967291.
+class PrimeBucketMapping {
+  public:
+    // O(log(n))
+    static size_t RoundBucketCount(size_t n) {
+        static constexpr uint32_t kPrimes[] = {
+            2, 5, 11, 17, 37, 67, 131, 257, 521, 1031, 2053, 4099, 8209, 16411, 32771, 65537, 131101, 262147,
+            524309, 1048583, 2097169, 4194319, 8388617, 16777259, 33554467, 67108879, 134217757, 268435459,
+            536870923, 1073741827, 2147483659u, 4294967291u};
+        for (uint32_t prime : kPrimes) {
+            if (prime >= n) {
+                return prime;
+            }
+        }
+        return kPrimes[sizeof(kPrimes) / sizeof(kPrimes[0]) - 1];
+    }
+
+    // O(1)
+    void Reset(size_t bucket_count) {
+        bucket_count_ = static_cast<uint32_t>(bucket_count);
+        reciprocal_ = UINT64_C(0xFFFFFFFFFFFFFFFF) / bucket_count_ + 1;
+    }
+
+    // O(1)
+    size_t Bucket(size_t hash) const {
+        uint64_t wide_hash = static_cast<uint64_t>(hash);
+        uint32_t folded = static_cast<uint32_t>(wide_hash ^ (wide_hash >> 32));
+#if defined(__SIZEOF_INT128__)
+        uint64_t fraction = reciprocal_ * folded;
+        return static_cast<size_t>((static_cast<unsigned __int128>(fraction) * bucket_count_) >> 64);
+#else
+        return folded % bucket_count_;
+#endif
+    }
+
+  private:
+    uint32_t bucket_count_ = 1;
+    uint64_t reciprocal_ = 0;
+};
+
+// Splits hashes over a power of two number of shards, as ConcurrentHashMap and ShardedBoundedCache do.
+// The hash is mixed first, since the highest bits of weak hashes (such as identity hashes of integers)
+// are often zero, and the same bits must not be the ones the bucket mapping inside a shard relies on.
+// The shard is given by the highest bits of the mixed hash, the shift is computed once at construction.
+class ShardMapping {
+  public:
+    // O(log(shard_count))
+    constexpr explicit ShardMapping(size_t shard_count) : shift_(kWidth - 1), mask_(shard_count - 1) {
+        size_t bits = 0;
+        while ((static_cast<size_t>(1) << bits) < shard_count) {
+            ++bits;
+        }
+        // A shift by the full width is undefined, so a single shard is handled by the mask.
+        shift_ = bits == 0 ? kWidth - 1 : kWidth - bits;
+    }
+
+    // O(1)
+    constexpr size_t ShardOf(uint64_t hash) const {
+        hash ^= hash >> 33;
+        hash *= UINT64_C(0xff51afd7ed558ccd);
+        hash ^= hash >> 33;
+        return static_cast<size_t>(hash >> shift_) & mask_;
+    }
+
+  private:
+    static constexpr size_t kWidth = 64;
+
+    size_t shift_, mask_;
+};
+
+// Hints the processor to bring the cache line holding given address closer, without waiting for it.
+// O(1)
+inline void PrefetchAddress(const void *address) {
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+// Allocator for objects of type T obtained from the allocator of a container.
+template<class Allocator, class T>
+using RebindAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+// Index policies.
+// An index maps the hash of a key to positions of candidate entries in the main data storage.
+// Every policy provides the same interface:
+// - Reset(capacity) drops all entries and resizes the index for the given hashmap capacity;
+// Reset(0) releases all memory, and an index reset to 0 only supports Reset(), SlotCount(), DrainSlot() and Swap();
+// - Find(hash, matches) returns the first stored position for which matches(position) holds, kNotFound otherwise;
+// - Insert(hash, position) records a new position;
+// - Erase(hash, position) forgets a recorded position;
+// - Replace(hash, old_position, new_position) redirects a recorded position after the entry has been moved.
+// Erase() and Replace() return false if the position is not recorded.
+// Batched lookups additionally use:
+// - Prefetch(hash) issuing a prefetch of the memory where the search for hash starts;
+// - Peek(hash) returning a recorded position the search for hash examines first, kNotFound if there is none.
+// HashMap::stats() additionally uses MemoryUsage() returning the number of bytes allocated by the index,
+// and HomeBucket(hash) returning the bucket (chain, home slot, home group) where the search for hash starts,
+// below BucketCount().
+// After every insertion HashMap asks ShouldRehash(), which returns true once erasures have left the index slower
+// than a fresh one of the same size; HashMap then resets it and records all positions again.
+// Positions are compared by value, so Erase() and Replace() never touch the keys.
+// Index policies are templates over a bucket mapping, an allocator and the unsigned type positions are stored as,
+// the typedefs without the Basic prefix use FibonacciBucketMapping, std::allocator and size_t,
+// the Compact typedefs store 32-bit positions, halving the memory of open addressing indices.
+// kMaxPositions is the number of positions the index can record, HashMap never holds more elements;
+// the largest value of the position type is left out, so that no position ever equals kNotFound.
+// Rebind<OtherAllocator> names the same policy with another allocator, HashMap uses it to pass its own allocator down.
+// To be wrapped by IncrementalIndex, a policy also provides:
+// - SlotCount() returning the number of slots (chains, buckets) of the index;
+// - DrainSlot(slot, visit) forgetting every position stored in the slot and calling visit(position) for each;
+// - Swap(other) exchanging the contents of two indices with equal allocators.
+
+// Separate chaining. https://en.wikipedia.org/wiki/Hash_table#Separate_chaining
+// Chains are implemented with std::list<> and contain indices of data entries in main storage.
+// Both the chain nodes and the array of chains are allocated with the given allocator.
+template<class BucketMapping = FibonacciBucketMapping, class Allocator = std::allocator<size_t>, class Position = size_t>
+class BasicChainedIndex {
+    static_assert(std::is_unsigned<Position>::value, "positions must be stored as an unsigned integer type");
+
+  public:
+    static constexpr size_t kNotFound = static_cast<size_t>(-1);
+    static constexpr size_t kMaxPositions = std::numeric_limits<Position>::max() - 1;
+
+    template<class OtherAllocator>
+    using Rebind = BasicChainedIndex<BucketMapping, OtherAllocator, Position>;
+
+    explicit BasicChainedIndex(size_t capacity = 1, const Allocator &allocator = Allocator())
+        : chains_(RebindAllocator<Allocator, Chain>(allocator)), node_allocator_(allocator) {
+        Reset(capacity);
+    }
+
+    // Time complexity: O(capacity).
+    void Reset(size_t capacity) {
+        if (capacity == 0) {
+            chains_.clear();
+            chains_.shrink_to_fit();
+            return;
+        }
+        size_t chain_count = BucketMapping::RoundBucketCount(capacity);
+        chains_.assign(chain_count, Chain(node_allocator_));
+        mapping_.Reset(chain_count);
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    template<class Matches>
+    size_t Find(size_t hash, Matches matches) const {
+        for (size_t position : chains_[mapping_.Bucket(hash)]) {
+            if (matches(position)) {
+                return position;
+            }
+        }
+        return kNotFound;
+    }
+
+    // Time complexity: O(1).
+    void Insert(size_t hash, size_t position) {
+        chains_[mapping_.Bucket(hash)].push_back(static_cast<Position>(position));
+    }
+
+    // O(1)
+    void Prefetch(size_t hash) const {
+        PrefetchAddress(&chains_[mapping_.Bucket(hash)]);
+    }
+
+    // O(1)
+    size_t Peek(size_t hash) const {
+        const Chain &chain = chains_[mapping_.Bucket(hash)];
+        return chain.empty() ? kNotFound : chain.front();
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    bool Erase(size_t hash, size_t position) {
+        auto &chain = chains_[mapping_.Bucket(hash)];
+        for (auto it = chain.begin(); it != chain.end(); ++it) {
+            if (*it == position) {
+                chain.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    bool Replace(size_t hash, size_t old_position, size_t new_position) {
+        for (Position &position : chains_[mapping_.Bucket(hash)]) {
+            if (position == old_position) {
+                position = static_cast<Position>(new_position);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // O(1)
+    size_t SlotCount() const {
+        return chains_.size();
+    }
+
+    // O(1)
+    size_t HomeBucket(size_t hash) const {
+        return mapping_.Bucket(hash);
+    }
+
+    // O(1)
+    size_t BucketCount() const {
+        return chains_.size();
+    }
+
+    // Every list node holds a position and two links.
+    // Time complexity: O(capacity).
+    size_t MemoryUsage() const {
+        size_t nodes = 0;
+        for (const Chain &chain : chains_) {
+            nodes += chain.size();
+        }
+        return chains_.capacity() * sizeof(Chain) + nodes * (sizeof(Position) + 2 * sizeof(void*));
+    }
+
+    // Erasing unlinks chain nodes, the index never degrades. O(1)
+    bool ShouldRehash() const {
+        return false;
+    }
+
+    // Time complexity: O(length of the chain).
+    template<class Visitor>
+    void DrainSlot(size_t slot, Visitor visit) {
+        for (size_t position : chains_[slot]) {
+            visit(position);
+        }
+        chains_[slot].clear();
+    }
+
+    // O(1)
+    void Swap(BasicChainedIndex &other) {
+        chains_.swap(other.chains_);
+        std::swap(mapping_, other.mapping_);
+    }
+
+  private:
+    typedef std::list<Position, RebindAllocator<Allocator, Position>> Chain;
+
+    std::vector<Chain, RebindAllocator<Allocator, Chain>> chains_;
+    RebindAllocator<Allocator, size_t> node_allocator_;
+    BucketMapping mapping_;
+};
+
+typedef BasicChainedIndex<> ChainedIndex;
+// List nodes are padded to pointer alignment, so narrower positions rarely save memory with chaining.
+typedef BasicChainedIndex<FibonacciBucketMapping, std::allocator<size_t>, uint32_t> CompactChainedIndex;
+
+// Open addressing with Robin Hood linear probing. https://en.wikipedia.org/wiki/Hash_table#Robin_Hood_hashing
+// All positions are stored in a single contiguous array of slots, so there is no per-element allocation
+// and a lookup touches consecutive memory only.
+// Each slot keeps its distance from the home slot, which bounds unsuccessful searches
+// and allows erasing with backward shifting instead of tombstones.
+template<class BucketMapping = FibonacciBucketMapping, class Allocator = std::allocator<size_t>, class Position = size_t>
+class BasicRobinHoodIndex {
+    static_assert(std::is_unsigned<Position>::value, "positions must be stored as an unsigned integer type");
+
+  public:
+    static constexpr size_t kNotFound = static_cast<size_t>(-1);
+    static constexpr size_t kMaxPositions = std::numeric_limits<Position>::max() - 1;
+    // Number of slots per unit of hashmap capacity. The default resize policy keeps at most 2 elements
+    // per unit of capacity, so the slot array never becomes more than half full.
+    // Resize policies used with open addressing must keep fewer than kSlotsPerBucket elements per unit of capacity.
+    static constexpr size_t kSlotsPerBucket = 4;
+
+    template<class OtherAllocator>
+    using Rebind = BasicRobinHoodIndex<BucketMapping, OtherAllocator, Position>;
+
+    explicit BasicRobinHoodIndex(size_t capacity = 1, const Allocator &allocator = Allocator())
+        : slots_(RebindAllocator<Allocator, Slot>(allocator)) {
+        Reset(capacity);
+    }
+
+    // Time complexity: O(capacity).
+    void Reset(size_t capacity) {
+        if (capacity == 0) {
+            slots_.clear();
+            slots_.shrink_to_fit();
+            return;
+        }
+        size_t slot_count = BucketMapping::RoundBucketCount(capacity * kSlotsPerBucket);
+        slots_.assign(slot_count, Slot());
+        mapping_.Reset(slot_count);
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    template<class Matches>
+    size_t Find(size_t hash, Matches matches) const {
+        size_t slot = mapping_.Bucket(hash);
+        for (size_t distance = 1; slots_[slot].distance >= distance; ++distance) {
+            if (matches(slots_[slot].position)) {
+                return slots_[slot].position;
+            }
+            slot = Next(slot);
+        }
+        return kNotFound;
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    void Insert(size_t hash, size_t position) {
+        Slot carried{static_cast<Position>(position), 1};
+        size_t slot = mapping_.Bucket(hash);
+        while (slots_[slot].distance != 0) {
+            if (slots_[slot].distance < carried.distance) {
+                std::swap(slots_[slot], carried);
+            }
+            ++carried.distance;
+            slot = Next(slot);
+        }
+        slots_[slot] = carried;
+    }
+
+    // O(1)
+    void Prefetch(size_t hash) const {
+        PrefetchAddress(&slots_[mapping_.Bucket(hash)]);
+    }
+
+    // O(1)
+    size_t Peek(size_t hash) const {
+        const Slot &slot = slots_[mapping_.Bucket(hash)];
+        return slot.distance != 0 ? slot.position : kNotFound;
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    bool Erase(size_t hash, size_t position) {
+        size_t slot = Locate(hash, position);
+        if (slot == kNotFound) {
+            return false;
         }
+        EraseSlot(slot);
+        return true;
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    bool Replace(size_t hash, size_t old_position, size_t new_position) {
+        size_t slot = Locate(hash, old_position);
+        if (slot == kNotFound) {
+            return false;
+        }
+        slots_[slot].position = static_cast<Position>(new_position);
+        return true;
+    }
+
+    // O(1)
+    size_t SlotCount() const {
+        return slots_.size();
+    }
+
+    // O(1)
+    size_t HomeBucket(size_t hash) const {
+        return mapping_.Bucket(hash);
+    }
+
+    // O(1)
+    size_t BucketCount() const {
+        return slots_.size();
+    }
+
+    // O(1)
+    size_t MemoryUsage() const {
+        return slots_.capacity() * sizeof(Slot);
+    }
+
+    // Erasing shifts the following entries back, so the index never degrades. O(1)
+    bool ShouldRehash() const {
+        return false;
+    }
+
+    // Backward shifting may move the next position into the drained slot, so the slot is drained until it is empty.
+    // Entries are only ever shifted towards the slot, hence draining slots in increasing order empties the index.
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    template<class Visitor>
+    void DrainSlot(size_t slot, Visitor visit) {
+        while (slots_[slot].distance != 0) {
+            size_t position = slots_[slot].position;
+            EraseSlot(slot);
+            visit(position);
+        }
+    }
+
+    // O(1)
+    void Swap(BasicRobinHoodIndex &other) {
+        slots_.swap(other.slots_);
+        std::swap(mapping_, other.mapping_);
+    }
+
+  private:
+    // The distance never exceeds the number of stored positions, so it fits the position type too.
+    struct Slot {
+        Position position = 0;
+        // Probe length of the stored position plus one, 0 marks an empty slot.
+        Position distance = 0;
     };
 
+    std::vector<Slot, RebindAllocator<Allocator, Slot>> slots_;
+    BucketMapping mapping_;
+
+    // Returns the slot following the given one, wrapping around the end of the array.
+    // Time complexity: O(1).
+    size_t Next(size_t slot) const {
+        return slot + 1 == slots_.size() ? 0 : slot + 1;
+    }
+
+    // Returns the slot holding given position, kNotFound if there is none.
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    size_t Locate(size_t hash, size_t position) const {
+        size_t slot = mapping_.Bucket(hash);
+        for (size_t distance = 1; slots_[slot].distance >= distance; ++distance) {
+            if (slots_[slot].position == position) {
+                return slot;
+            }
+            slot = Next(slot);
+        }
+        return kNotFound;
+    }
+
+    // Empties given slot, shifting the following entries one slot back until one of them is at its home slot.
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    void EraseSlot(size_t slot) {
+        size_t next = Next(slot);
+        while (slots_[next].distance > 1) {
+            slots_[slot] = slots_[next];
+            --slots_[slot].distance;
+            slot = next;
+            next = Next(next);
+        }
+        slots_[slot] = Slot();
+    }
+};
+
+typedef BasicRobinHoodIndex<> RobinHoodIndex;
+typedef BasicRobinHoodIndex<FibonacciBucketMapping, std::allocator<size_t>, uint32_t> CompactRobinHoodIndex;
+
+// Control-byte groups for GroupProbingIndex.
+// Every slot of the index has a control byte: kEmptyControl, kDeletedControl,
+// or the lower 7 bits of the hash of the stored key for a full slot.
+// A group compares all of its control bytes against a single byte at once
+// and returns a bit mask with bit i set iff control byte i matched.
+// AVX2 compares 32 bytes per instruction, SSE2 compares 16, other targets fall back to scalar code.
+constexpr int8_t kEmptyControl = -128;
+constexpr int8_t kDeletedControl = -2;
+
+#if defined(__AVX2__)
+class ControlGroup {
+  public:
+    static constexpr size_t kWidth = 32;
+
+    explicit ControlGroup(const int8_t *controls)
+        : controls_(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(controls))) {}
+
     // O(1)
-    iterator begin() {
-        return iterator(hashmap_.begin());
+    uint32_t Match(int8_t control) const {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(controls_, _mm256_set1_epi8(control))));
+    }
+
+    // O(1)
+    uint32_t MatchEmpty() const {
+        return Match(kEmptyControl);
+    }
+
+    // Empty and deleted control bytes are the only negative ones.
+    // O(1)
+    uint32_t MatchEmptyOrDeleted() const {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(controls_));
+    }
+
+  private:
+    __m256i controls_;
+};
+#elif defined(__SSE2__)
+class ControlGroup {
+  public:
+    static constexpr size_t kWidth = 16;
+
+    explicit ControlGroup(const int8_t *controls)
+        : controls_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(controls))) {}
+
+    // O(1)
+    uint32_t Match(int8_t control) const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(controls_, _mm_set1_epi8(control))));
+    }
+
+    // O(1)
+    uint32_t MatchEmpty() const {
+        return Match(kEmptyControl);
+    }
+
+    // Empty and deleted control bytes are the only negative ones.
+    // O(1)
+    uint32_t MatchEmptyOrDeleted() const {
+        return static_cast<uint32_t>(_mm_movemask_epi8(controls_));
+    }
+
+  private:
+    __m128i controls_;
+};
+#else
+class ControlGroup {
+  public:
+    static constexpr size_t kWidth = 16;
+
+    explicit ControlGroup(const int8_t *controls) : controls_(controls) {}
+
+    // O(kWidth)
+    uint32_t Match(int8_t control) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kWidth; ++i) {
+            mask |= static_cast<uint32_t>(controls_[i] == control) << i;
+        }
+        return mask;
+    }
+
+    // O(kWidth)
+    uint32_t MatchEmpty() const {
+        return Match(kEmptyControl);
+    }
+
+    // O(kWidth)
+    uint32_t MatchEmptyOrDeleted() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kWidth; ++i) {
+            mask |= static_cast<uint32_t>(controls_[i] < 0) << i;
+        }
+        return mask;
+    }
+
+  private:
+    const int8_t *controls_;
+};
+#endif
+
+// Returns the number of the lowest set bit of a non-zero mask.
+// O(1)
+inline size_t LowestBit(uint32_t mask) {
+#if defined(__GNUC__)
+    return static_cast<size_t>(__builtin_ctz(mask));
+#else
+    size_t bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+// Open addressing with control-byte groups, in the style of Swiss tables. https://abseil.io/about/design/swisstables
+// Next to the array of positions the index keeps an array of control bytes holding 7-bit hash fragments.
+// Lookups compare a whole ControlGroup of fragments at once and only call matches() on slots whose fragment agrees,
+// so most unsuccessful searches finish without a single key comparison.
+// Groups are probed linearly; a search stops at the first group with an empty slot.
+// Erased slots become tombstones unless their group still has an empty slot. Tombstones are reused by insertions
+// and counted; once together with the full slots they leave less than kMinEmptyShare of the slots empty,
+// ShouldRehash() asks for the index to be rebuilt at the same size, which drops them.
+template<class BucketMapping = FibonacciBucketMapping, class Allocator = std::allocator<size_t>, class Position = size_t>
+class BasicGroupProbingIndex {
+    static_assert(std::is_unsigned<Position>::value, "positions must be stored as an unsigned integer type");
+
+  public:
+    static constexpr size_t kNotFound = static_cast<size_t>(-1);
+    static constexpr size_t kMaxPositions = std::numeric_limits<Position>::max() - 1;
+    // Number of slots per unit of hashmap capacity, see RobinHoodIndex::kSlotsPerBucket.
+    static constexpr size_t kSlotsPerBucket = 4;
+    // Share of the slots which is kept empty, as Swiss tables do with their maximum load of 7/8:
+    // searches stop at empty slots only, so without them every unsuccessful one would scan the whole index.
+    static constexpr size_t kMinEmptyShare = 8;
+
+    template<class OtherAllocator>
+    using Rebind = BasicGroupProbingIndex<BucketMapping, OtherAllocator, Position>;
+
+    explicit BasicGroupProbingIndex(size_t capacity = 1, const Allocator &allocator = Allocator())
+        : controls_(RebindAllocator<Allocator, int8_t>(allocator)), positions_(RebindAllocator<Allocator, Position>(allocator)) {
+        Reset(capacity);
+    }
+
+    // Time complexity: O(capacity).
+    void Reset(size_t capacity) {
+        full_count_ = deleted_count_ = 0;
+        if (capacity == 0) {
+            group_count_ = 0;
+            controls_.clear();
+            controls_.shrink_to_fit();
+            positions_.clear();
+            positions_.shrink_to_fit();
+            return;
+        }
+        group_count_ = BucketMapping::RoundBucketCount(
+            (capacity * kSlotsPerBucket + ControlGroup::kWidth - 1) / ControlGroup::kWidth);
+        mapping_.Reset(group_count_);
+        controls_.assign(group_count_ * ControlGroup::kWidth, kEmptyControl);
+        positions_.assign(group_count_ * ControlGroup::kWidth, 0);
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    template<class Matches>
+    size_t Find(size_t hash, Matches matches) const {
+        size_t slot = Search(hash, [&](size_t position) {
+            return matches(position);
+        });
+        return slot == kNotFound ? kNotFound : positions_[slot];
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    void Insert(size_t hash, size_t position) {
+        size_t group = HomeGroup(hash);
+        while (true) {
+            uint32_t free = ControlGroup(&controls_[group * ControlGroup::kWidth]).MatchEmptyOrDeleted();
+            if (free != 0) {
+                size_t slot = group * ControlGroup::kWidth + LowestBit(free);
+                if (controls_[slot] == kDeletedControl) {
+                    --deleted_count_;
+                }
+                ++full_count_;
+                controls_[slot] = Fragment(hash);
+                positions_[slot] = static_cast<Position>(position);
+                return;
+            }
+            group = NextGroup(group);
+        }
+    }
+
+    // O(1)
+    void Prefetch(size_t hash) const {
+        size_t group_start = HomeGroup(hash) * ControlGroup::kWidth;
+        PrefetchAddress(&controls_[group_start]);
+        PrefetchAddress(&positions_[group_start]);
+    }
+
+    // O(1)
+    size_t Peek(size_t hash) const {
+        size_t group_start = HomeGroup(hash) * ControlGroup::kWidth;
+        uint32_t mask = ControlGroup(&controls_[group_start]).Match(Fragment(hash));
+        return mask != 0 ? positions_[group_start + LowestBit(mask)] : kNotFound;
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    bool Erase(size_t hash, size_t position) {
+        size_t slot = Locate(hash, position);
+        if (slot == kNotFound) {
+            return false;
+        }
+        EraseSlot(slot);
+        return true;
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    bool Replace(size_t hash, size_t old_position, size_t new_position) {
+        size_t slot = Locate(hash, old_position);
+        if (slot == kNotFound) {
+            return false;
+        }
+        positions_[slot] = static_cast<Position>(new_position);
+        return true;
+    }
+
+    // O(1)
+    size_t SlotCount() const {
+        return controls_.size();
+    }
+
+    // Buckets are the groups of ControlGroup::kWidth slots. O(1)
+    size_t HomeBucket(size_t hash) const {
+        return HomeGroup(hash);
+    }
+
+    // O(1)
+    size_t BucketCount() const {
+        return group_count_;
+    }
+
+    // O(1)
+    size_t MemoryUsage() const {
+        return controls_.capacity() * sizeof(int8_t) + positions_.capacity() * sizeof(Position);
+    }
+
+    // Tombstones are only worth dropping once there are enough of them to pay for the rebuild,
+    // so that an index kept full by its resize policy is not rebuilt after every insertion.
+    // O(1)
+    bool ShouldRehash() const {
+        size_t slots = controls_.size();
+        return deleted_count_ > slots / (2 * kMinEmptyShare) &&
+               full_count_ + deleted_count_ > slots - slots / kMinEmptyShare;
+    }
+
+    // O(1)
+    template<class Visitor>
+    void DrainSlot(size_t slot, Visitor visit) {
+        if (controls_[slot] >= 0) {
+            EraseSlot(slot);
+            visit(positions_[slot]);
+        }
+    }
+
+    // O(1)
+    void Swap(BasicGroupProbingIndex &other) {
+        std::swap(group_count_, other.group_count_);
+        std::swap(full_count_, other.full_count_);
+        std::swap(deleted_count_, other.deleted_count_);
+        controls_.swap(other.controls_);
+        positions_.swap(other.positions_);
+        std::swap(mapping_, other.mapping_);
+    }
+
+  private:
+    size_t group_count_ = 0;
+    // Numbers of slots holding a position and of tombstones.
+    size_t full_count_ = 0, deleted_count_ = 0;
+    std::vector<int8_t, RebindAllocator<Allocator, int8_t>> controls_;
+    std::vector<Position, RebindAllocator<Allocator, Position>> positions_;
+    BucketMapping mapping_;
+
+    // Returns the 7-bit hash fragment stored in control bytes.
+    // O(1)
+    static int8_t Fragment(size_t hash) {
+        return static_cast<int8_t>(hash & 0x7F);
+    }
+
+    // O(1)
+    size_t HomeGroup(size_t hash) const {
+        return mapping_.Bucket(hash >> 7);
+    }
+
+    // O(1)
+    size_t NextGroup(size_t group) const {
+        return group + 1 == group_count_ ? 0 : group + 1;
+    }
+
+    // Returns the slot of the first full slot with matching fragment for which matches(position) holds,
+    // kNotFound if there is none.
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    template<class Matches>
+    size_t Search(size_t hash, Matches matches) const {
+        int8_t fragment = Fragment(hash);
+        size_t group = HomeGroup(hash);
+        for (size_t probes = 0; probes < group_count_; ++probes) {
+            size_t group_start = group * ControlGroup::kWidth;
+            ControlGroup controls(&controls_[group_start]);
+            for (uint32_t mask = controls.Match(fragment); mask != 0; mask &= mask - 1) {
+                size_t slot = group_start + LowestBit(mask);
+                if (matches(positions_[slot])) {
+                    return slot;
+                }
+            }
+            if (controls.MatchEmpty() != 0) {
+                return kNotFound;
+            }
+            group = NextGroup(group);
+        }
+        return kNotFound;
+    }
+
+    // Returns the slot holding given position, kNotFound if there is none.
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    size_t Locate(size_t hash, size_t position) const {
+        return Search(hash, [position](size_t candidate) {
+            return candidate == position;
+        });
+    }
+
+    // Marks given full slot as free.
+    // O(1)
+    void EraseSlot(size_t slot) {
+        size_t group_start = slot - slot % ControlGroup::kWidth;
+        // If the group still has an empty slot, no search has ever continued past it,
+        // so the slot can be freed without leaving a tombstone.
+        bool has_empty = ControlGroup(&controls_[group_start]).MatchEmpty() != 0;
+        controls_[slot] = has_empty ? kEmptyControl : kDeletedControl;
+        --full_count_;
+        if (!has_empty) {
+            ++deleted_count_;
+        }
+    }
+};
+
+typedef BasicGroupProbingIndex<> GroupProbingIndex;
+typedef BasicGroupProbingIndex<FibonacciBucketMapping, std::allocator<size_t>, uint32_t> CompactGroupProbingIndex;
+
+// Incremental rehashing. https://en.wikipedia.org/wiki/Hash_table#Incremental_resizing
+// Wraps another index policy so that resizing does not stop the world:
+// StartResize() keeps the old table live next to a new one, and every Advance() call
+// moves the positions of at most kSlotsPerStep old slots to the new table.
+// Lookups consult the new table first and the old one while migration is in progress, new positions go to the new table.
+// An unfinished migration is completed before the next resize begins.
+template<class Inner, size_t kSlotsPerStep = 8>
+class IncrementalIndex {
+  public:
+    static constexpr size_t kNotFound = Inner::kNotFound;
+    static constexpr size_t kMaxPositions = Inner::kMaxPositions;
+
+    template<class OtherAllocator>
+    using Rebind = IncrementalIndex<typename Inner::template Rebind<OtherAllocator>, kSlotsPerStep>;
+
+    template<class Allocator = std::allocator<size_t>>
+    explicit IncrementalIndex(size_t capacity = 1, const Allocator &allocator = Allocator())
+        : current_(capacity, allocator), previous_(0, allocator) {}
+
+    // Time complexity: O(capacity).
+    void Reset(size_t capacity) {
+        current_.Reset(capacity);
+        previous_.Reset(0);
+        migrating_ = false;
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    template<class Matches>
+    size_t Find(size_t hash, Matches matches) const {
+        size_t position = current_.Find(hash, matches);
+        if (position != kNotFound || !migrating_) {
+            return position;
+        }
+        return previous_.Find(hash, matches);
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    void Insert(size_t hash, size_t position) {
+        current_.Insert(hash, position);
+    }
+
+    // Only the new table is prefetched, most positions live there.
+    // O(1)
+    void Prefetch(size_t hash) const {
+        current_.Prefetch(hash);
+    }
+
+    // O(1)
+    size_t Peek(size_t hash) const {
+        return current_.Peek(hash);
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    bool Erase(size_t hash, size_t position) {
+        return current_.Erase(hash, position) || (migrating_ && previous_.Erase(hash, position));
+    }
+
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    bool Replace(size_t hash, size_t old_position, size_t new_position) {
+        return current_.Replace(hash, old_position, new_position) ||
+               (migrating_ && previous_.Replace(hash, old_position, new_position));
+    }
+
+    // Begins moving all positions to a new table sized for given capacity.
+    // hash_of(position) must return the hash of the key stored at position.
+    // Time complexity: O(capacity), unless the previous migration has not been finished yet.
+    template<class HashOf>
+    void StartResize(size_t capacity, HashOf hash_of) {
+        while (migrating_) {
+            Advance(hash_of);
+        }
+        current_.Swap(previous_);
+        current_.Reset(capacity);
+        migrated_slots_ = 0;
+        // An unallocated old table has nothing to migrate.
+        migrating_ = previous_.SlotCount() != 0;
+    }
+
+    // Moves the positions of at most kSlotsPerStep slots of the old table to the new one.
+    // Time complexity: expected O(kSlotsPerStep), provided the hash function is good enough.
+    template<class HashOf>
+    void Advance(HashOf hash_of) {
+        if (!migrating_) {
+            return;
+        }
+        for (size_t step = 0; step < kSlotsPerStep && migrated_slots_ < previous_.SlotCount(); ++step) {
+            previous_.DrainSlot(migrated_slots_++, [this, &hash_of](size_t position) {
+                current_.Insert(hash_of(position), position);
+            });
+        }
+        if (migrated_slots_ == previous_.SlotCount()) {
+            previous_.Reset(0);
+            migrating_ = false;
+        }
+    }
+
+    // O(1)
+    bool Migrating() const {
+        return migrating_;
+    }
+
+    // Buckets are those of the new table, positions not migrated yet count towards the bucket they will move to.
+    // O(1)
+    size_t HomeBucket(size_t hash) const {
+        return current_.HomeBucket(hash);
+    }
+
+    // O(1)
+    size_t BucketCount() const {
+        return current_.BucketCount();
+    }
+
+    // Time complexity: that of Inner::MemoryUsage().
+    size_t MemoryUsage() const {
+        return current_.MemoryUsage() + previous_.MemoryUsage();
+    }
+
+    // The old table is drained by the migration anyway, only the new one is checked.
+    // Time complexity: that of Inner::ShouldRehash().
+    bool ShouldRehash() const {
+        return current_.ShouldRehash();
+    }
+
+  private:
+    Inner current_, previous_;
+    bool migrating_ = false;
+    size_t migrated_slots_ = 0;
+};
+
+template<class IndexPolicy>
+struct IsIncrementalIndex : std::false_type {};
+
+template<class Inner, size_t kSlotsPerStep>
+struct IsIncrementalIndex<IncrementalIndex<Inner, kSlotsPerStep>> : std::true_type {};
+
+// Helpers keeping an index in step with the dense storage of a map, shared by HashMap and SoaHashMap.
+// Positions 0 to positions - 1 of storage hold elements, except those for which is_hole(position) is true,
+// and position_hasher(position) returns the hash of the key stored at position.
+
+// Throws std::length_error if Index cannot record count positions.
+// O(1)
+template<class Index>
+void CheckPositionLimit(size_t count) {
+    if (count > Index::kMaxPositions) {
+        throw std::length_error("too many elements for the position type of the index");
+    }
+}
+
+// Resets index to capacity and records the positions of all elements again, also for an IncrementalIndex,
+// which is needed whenever positions change wholesale.
+// Time complexity: O(positions + capacity).
+template<class Index, class PositionHasher, class IsHole>
+void ResetIndex(Index &index, size_t capacity, size_t positions, PositionHasher position_hasher, IsHole is_hole) {
+    index.Reset(capacity);
+    for (size_t position = 0; position < positions; ++position) {
+        if (!is_hole(position)) {
+            index.Insert(position_hasher(position), position);
+        }
+    }
+}
+
+// Rebuilds index for a new capacity. An IncrementalIndex only starts migrating, AdvanceIndex() continues.
+// Time complexity: O(positions + capacity), O(1) for an IncrementalIndex.
+template<class Index, class PositionHasher, class IsHole>
+void RebuildIndex(Index &index, size_t capacity, size_t positions, PositionHasher position_hasher, IsHole is_hole) {
+    if constexpr (IsIncrementalIndex<Index>::value) {
+        (void)positions;
+        (void)is_hole;
+        index.StartResize(capacity, position_hasher);
+    } else {
+        ResetIndex(index, capacity, positions, position_hasher, is_hole);
+    }
+}
+
+// Lets an IncrementalIndex migrate a bounded number of slots, does nothing for other index policies.
+// Time complexity: O(1).
+template<class Index, class PositionHasher>
+void AdvanceIndex(Index &index, PositionHasher position_hasher) {
+    if constexpr (IsIncrementalIndex<Index>::value) {
+        index.Advance(position_hasher);
+    } else {
+        (void)index;
+        (void)position_hasher;
+    }
+}
+
+// Resize policies.
+// A resize policy decides the capacity of HashMap, which is rebuilt whenever the returned capacity differs from the current one:
+// - GrowCapacity(size, capacity) is called before inserting into a hashmap holding size elements;
+// - ShrinkCapacity(size, capacity) is called after erasing an element;
+// - FitCapacity(size, capacity) is called by HashMap::shrink_to_fit();
+// - ReserveCapacity(size, min_capacity) is called by HashMap::reserve() and HashMap::rehash(),
+// returns a capacity of at least min_capacity which holds size elements without growing.
+// Returned capacities must be positive, and grown capacities must leave room for one more element.
+
+// Resizes geometrically with hysteresis:
+// - if the number of elements reaches capacity multiplied by kMaxLoadFactor,
+// capacity is increased to kScalingFactor times the original;
+// - if the capacity reaches kMinLoadFactor times the number of elements, it is reduced kScalingFactor-fold.
+// Right after a resize the map is kMaxLoadFactor * kMinLoadFactor / kScalingFactor times away from the opposite threshold,
+// so choosing a larger kMinLoadFactor widens the gap which stops a workload toggling around one boundary
+// from rebuilding the map over and over.
+// If kAutoShrink is false, erasing never shrinks the map, capacity is only reduced by shrink_to_fit().
+template<size_t kMaxLoadFactor = 2, size_t kMinLoadFactor = 4, size_t kScalingFactor = 2, bool kAutoShrink = true>
+class LoadFactorResizePolicy {
+  public:
+    static_assert(kMaxLoadFactor > 0 && kScalingFactor > 1, "resize policy must grow the map");
+    static_assert(kMinLoadFactor >= kScalingFactor, "shrinking must not bring the map over its maximum load");
+
+    // O(1)
+    size_t GrowCapacity(size_t size, size_t capacity) const {
+        if (size >= capacity * kMaxLoadFactor) {
+            return capacity * kScalingFactor;
+        }
+        return capacity;
+    }
+
+    // O(1)
+    size_t ShrinkCapacity(size_t size, size_t capacity) const {
+        if (kAutoShrink && capacity > 1 && size * kMinLoadFactor <= capacity) {
+            return capacity / kScalingFactor;
+        }
+        return capacity;
+    }
+
+    // Returns the smallest capacity reachable by shrinking, which still leaves room for one more element.
+    // Time complexity: O(log(capacity)).
+    size_t FitCapacity(size_t size, size_t capacity) const {
+        while (capacity / kScalingFactor > 0 && size < capacity / kScalingFactor * kMaxLoadFactor) {
+            capacity /= kScalingFactor;
+        }
+        return capacity;
+    }
+
+    // Returns the smallest capacity of the form kScalingFactor^i satisfying the requirements.
+    // Time complexity: O(log(capacity)).
+    size_t ReserveCapacity(size_t size, size_t min_capacity) const {
+        size_t capacity = 1;
+        while (capacity < min_capacity || size > capacity * kMaxLoadFactor) {
+            capacity *= kScalingFactor;
+        }
+        return capacity;
+    }
+};
+
+// The resize policy HashMap has always had.
+typedef LoadFactorResizePolicy<> DefaultResizePolicy;
+// Never shrinks on erase; memory is only given back by an explicit shrink_to_fit().
+typedef LoadFactorResizePolicy<2, 4, 2, false> LazyShrinkResizePolicy;
+
+// Stats policies. A stats policy decides which runtime counters HashMap maintains for HashMap::stats():
+// kEnabled tells whether there are any, and RebuildTimer is constructed from the policy for the duration of every rebuild.
+
+// Maintains no counters, so instrumentation costs nothing. The default.
+struct NoStats {
+    static constexpr bool kEnabled = false;
+
+    struct RebuildTimer {
+        explicit RebuildTimer(NoStats &) {}
+    };
+};
+
+// Counts rebuilds of the index and the time spent in them.
+// With IncrementalIndex only the start of every resize is timed, the migration is spread over later operations.
+struct CollectStats {
+    static constexpr bool kEnabled = true;
+
+    // Records the duration of its own lifetime as one rebuild.
+    class RebuildTimer {
+      public:
+        explicit RebuildTimer(CollectStats &stats) : stats_(stats), start_(std::chrono::steady_clock::now()) {}
+
+        RebuildTimer(const RebuildTimer &) = delete;
+        RebuildTimer &operator=(const RebuildTimer &) = delete;
+
+        ~RebuildTimer() {
+            ++stats_.rebuild_count;
+            stats_.rebuild_time += std::chrono::steady_clock::now() - start_;
+        }
+
+      private:
+        CollectStats &stats_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    size_t rebuild_count = 0;
+    std::chrono::nanoseconds rebuild_time{0};
+};
+
+// Erase policies. An erase policy decides how HashMap removes elements from data storage:
+// - kLazy tells whether erased elements are left in place as holes, instead of being replaced by the last element;
+// - ShouldCompact(size, holes) is called after every lazy erase, the holes are compacted away once it returns true.
+// Holes are skipped by iteration and keep their elements alive until compaction. Compaction is stable,
+// so with a lazy policy the data storage, and hence iteration, keeps insertion order.
+
+// Moves the last element into the erased position, the storage never has holes. The default.
+struct SwapErase {
+    static constexpr bool kLazy = false;
+
+    // O(1)
+    static bool ShouldCompact(size_t, size_t) {
+        return false;
+    }
+};
+
+// Deferred deletes: erase() only forgets the element in the index and marks its position as a hole,
+// compaction runs when HashMap::compact() is called. Suits bulk deletions which are followed by one compaction.
+struct DeferredErase {
+    static constexpr bool kLazy = true;
+
+    // O(1)
+    static bool ShouldCompact(size_t, size_t) {
+        return false;
+    }
+};
+
+// Insertion order: erasing leaves holes, which are compacted automatically once they outnumber the elements,
+// so iteration always visits the elements in the order they were inserted, memory stays within twice the dense
+// layout and erasing stays amortized O(1). begin() is O(1) even after erasing the oldest elements,
+// so the hashmap itself serves as a FIFO queue, e.g. for an eviction order: push with insert(), pop with erase(begin()).
+struct OrderedErase {
+    static constexpr bool kLazy = true;
+
+    // O(1)
+    static bool ShouldCompact(size_t size, size_t holes) {
+        return holes > size;
+    }
+};
+
+// Snapshot of the state of a hashmap returned by HashMap::stats().
+// The probe length of an element is the number of candidate positions its lookup has to compare,
+// that is chain position with chaining, distance with Robin Hood hashing, and candidates whose control byte
+// matched with group probing; every found element needs at least one. probe_length_histogram[i] counts
+// the elements with probe length i, so max_probe_length is the largest occupancy seen by any lookup.
+struct HashMapStats {
+    size_t size = 0;
+    size_t bucket_count = 0;
+    // Number of stored positions the index compares before finding an element, for every element.
+    std::vector<size_t> probe_length_histogram;
+    double mean_probe_length = 0;
+    size_t max_probe_length = 0;
+    // Largest number of elements sharing a bucket of the index (a chain, a home slot, a home group).
+    size_t max_bucket_occupancy = 0;
+    // Share of the elements whose full hash equals that of another element.
+    double hash_collision_rate = 0;
+    // Number of times a long probe sequence made the hashmap reseed its hash function, see SeededHash.
+    size_t reseed_count = 0;
+    // Only maintained with CollectStats.
+    size_t rebuild_count = 0;
+    std::chrono::nanoseconds rebuild_time{0};
+    // Bytes allocated by data storage, by stored hashes, by the hole markers of lazy erasure and by the index.
+    size_t storage_bytes = 0;
+    size_t hashes_bytes = 0;
+    size_t holes_bytes = 0;
+    size_t index_bytes = 0;
+
+    // Writes the stats in the Prometheus text exposition format, every metric name starting with given prefix.
+    // Time complexity: O(max_probe_length).
+    void ExportPrometheus(std::ostream &out, const std::string &prefix) const {
+        auto gauge = [&out, &prefix](const char *name, double value) {
+            out << "# TYPE " << prefix << '_' << name << " gauge\n" << prefix << '_' << name << ' ' << value << '\n';
+        };
+        gauge("size", static_cast<double>(size));
+        gauge("bucket_count", static_cast<double>(bucket_count));
+        gauge("max_probe_length", static_cast<double>(max_probe_length));
+        gauge("max_bucket_occupancy", static_cast<double>(max_bucket_occupancy));
+        gauge("hash_collision_rate", hash_collision_rate);
+        gauge("storage_bytes", static_cast<double>(storage_bytes));
+        gauge("hashes_bytes", static_cast<double>(hashes_bytes));
+        gauge("holes_bytes", static_cast<double>(holes_bytes));
+        gauge("index_bytes", static_cast<double>(index_bytes));
+        out << "# TYPE " << prefix << "_reseeds_total counter\n" << prefix << "_reseeds_total " << reseed_count << '\n';
+        out << "# TYPE " << prefix << "_rebuilds_total counter\n" << prefix << "_rebuilds_total " << rebuild_count << '\n';
+        out << "# TYPE " << prefix << "_rebuild_seconds_total counter\n" << prefix << "_rebuild_seconds_total "
+            << std::chrono::duration<double>(rebuild_time).count() << '\n';
+        out << "# TYPE " << prefix << "_probe_length histogram\n";
+        size_t cumulative = 0;
+        for (size_t length = 0; length < probe_length_histogram.size(); ++length) {
+            cumulative += probe_length_histogram[length];
+            out << prefix << "_probe_length_bucket{le=\"" << length << "\"} " << cumulative << '\n';
+        }
+        out << prefix << "_probe_length_bucket{le=\"+Inf\"} " << cumulative << '\n';
+        out << prefix << "_probe_length_sum " << mean_probe_length * static_cast<double>(size) << '\n';
+        out << prefix << "_probe_length_count " << size << '\n';
+    }
+};
+
+// Checks whether a hash or equality functor declares is_transparent,
+// that is, whether it accepts keys of types other than KeyType.
+template<class Functor, class = void>
+struct IsTransparent : std::false_type {};
+
+template<class Functor>
+struct IsTransparent<Functor, std::void_t<typename Functor::is_transparent>> : std::true_type {};
+
+// Heterogeneous overloads take part in overload resolution only if both functors declare is_transparent.
+template<class Hash, class KeyEqual, class K>
+using EnableIfTransparent = typename std::enable_if<IsTransparent<Hash>::value && IsTransparent<KeyEqual>::value, K>::type;
+
+// Transparent hash for std::string keys. Hashes std::string, std::string_view and const char* alike,
+// so that together with std::equal_to<> lookups by string literals or views do not allocate.
+struct TransparentStringHash {
+    typedef void is_transparent;
+
+    // O(length of the string)
+    size_t operator()(std::string_view key) const {
+        return std::hash<std::string_view>()(key);
+    }
+};
+
+// Returns 64 bits from std::random_device.
+inline uint64_t RandomSeed() {
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) ^ device();
+}
+
+// Seeded hash in the style of wyhash, for keys which may be chosen by an attacker. https://github.com/wangyi-fudan/wyhash
+// Hashes integers, enums and strings (std::string, std::string_view and const char* alike, so it is transparent)
+// by folded 64x64->128 bit multiplications keyed with the seed. Without the seed, colliding keys cannot be
+// precomputed, and a default constructed hash takes a random one, so every hashmap gets its own.
+// HashMap reseeds it through reseed() when an insertion meets a suspiciously long probe sequence, see HashMap.
+// The output is not meant to be stable across versions or machines.
+class SeededHash {
+  public:
+    typedef void is_transparent;
+
+    // Takes a random seed.
+    SeededHash() {
+        reseed(RandomSeed());
+    }
+
+    explicit SeededHash(uint64_t seed) {
+        reseed(seed);
+    }
+
+    // O(1)
+    void reseed(uint64_t seed) {
+        seed_ = Mix(seed ^ kSecret[0], kSecret[1]);
+    }
+
+    // Hashes compare equal if they hash alike, so that hashes computed by one are valid for the other. O(1)
+    friend bool operator==(const SeededHash &lhs, const SeededHash &rhs) {
+        return lhs.seed_ == rhs.seed_;
+    }
+
+    // O(1)
+    friend bool operator!=(const SeededHash &lhs, const SeededHash &rhs) {
+        return !(lhs == rhs);
+    }
+
+    // O(1)
+    template<class K, class = std::enable_if_t<std::is_integral<K>::value || std::is_enum<K>::value>>
+    size_t operator()(K key) const {
+        uint64_t value;
+        if constexpr (std::is_enum<K>::value) {
+            value = static_cast<uint64_t>(static_cast<std::underlying_type_t<K>>(key));
+        } else {
+            value = static_cast<uint64_t>(key);
+        }
+        return static_cast<size_t>(Finish(value ^ kSecret[1], seed_ ^ value, sizeof(K)));
+    }
+
+    // O(length of the string)
+    size_t operator()(std::string_view key) const {
+        const unsigned char *data = reinterpret_cast<const unsigned char*>(key.data());
+        size_t length = key.size();
+        uint64_t seed = seed_, a = 0, b = 0;
+        if (length <= 16) {
+            if (length >= 4) {
+                size_t middle = (length >> 3) << 2;
+                a = (Read32(data) << 32) | Read32(data + middle);
+                b = (Read32(data + length - 4) << 32) | Read32(data + length - 4 - middle);
+            } else if (length > 0) {
+                a = (static_cast<uint64_t>(data[0]) << 16) | (static_cast<uint64_t>(data[length >> 1]) << 8) |
+                    data[length - 1];
+            }
+        } else {
+            size_t remaining = length;
+            if (remaining > 48) {
+                uint64_t seed1 = seed, seed2 = seed;
+                do {
+                    seed = Mix(Read64(data) ^ kSecret[1], Read64(data + 8) ^ seed);
+                    seed1 = Mix(Read64(data + 16) ^ kSecret[2], Read64(data + 24) ^ seed1);
+                    seed2 = Mix(Read64(data + 32) ^ kSecret[3], Read64(data + 40) ^ seed2);
+                    data += 48;
+                    remaining -= 48;
+                } while (remaining > 48);
+                seed ^= seed1 ^ seed2;
+            }
+            while (remaining > 16) {
+                seed = Mix(Read64(data) ^ kSecret[1], Read64(data + 8) ^ seed);
+                data += 16;
+                remaining -= 16;
+            }
+            a = Read64(data + remaining - 16);
+            b = Read64(data + remaining - 8);
+        }
+        return static_cast<size_t>(Finish(a ^ kSecret[1], b ^ seed, length));
+    }
+
+  private:
+    static constexpr uint64_t kSecret[4] = {UINT64_C(0xa0761d6478bd642f), UINT64_C(0xe7037ed1a0b428db),
+                                            UINT64_C(0x8ebc6af09c88c6e3), UINT64_C(0x589965cc75374cc3)};
+
+    uint64_t seed_ = 0;
+
+    // Replaces a and b by the low and the high half of their 128-bit product. O(1)
+    static void Multiply(uint64_t &a, uint64_t &b) {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+        a = static_cast<uint64_t>(product);
+        b = static_cast<uint64_t>(product >> 64);
+#else
+        uint64_t a_high = a >> 32, a_low = static_cast<uint32_t>(a), b_high = b >> 32, b_low = static_cast<uint32_t>(b);
+        uint64_t high = a_high * b_high, middle1 = a_high * b_low, middle2 = a_low * b_high, low = a_low * b_low;
+        uint64_t carry = ((low >> 32) + static_cast<uint32_t>(middle1) + static_cast<uint32_t>(middle2)) >> 32;
+        a = low + (middle1 << 32) + (middle2 << 32);
+        b = high + (middle1 >> 32) + (middle2 >> 32) + carry;
+#endif
+    }
+
+    // Returns the 128-bit product of a and b, folded to 64 bits. O(1)
+    static uint64_t Mix(uint64_t a, uint64_t b) {
+        Multiply(a, b);
+        return a ^ b;
+    }
+
+    // Mixes the last two words, already keyed with the seed, and the length. O(1)
+    static uint64_t Finish(uint64_t a, uint64_t b, size_t length) {
+        Multiply(a, b);
+        return Mix(a ^ kSecret[0] ^ length, b ^ kSecret[1]);
+    }
+
+    // O(1)
+    static uint64_t Read64(const unsigned char *data) {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    // O(1)
+    static uint64_t Read32(const unsigned char *data) {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+};
+
+// Checks whether a hash functor can be reseeded, that is, whether it has reseed(uint64_t) like SeededHash.
+template<class Hash, class = void>
+struct IsReseedable : std::false_type {};
+
+template<class Hash>
+struct IsReseedable<Hash, std::void_t<decltype(std::declval<Hash&>().reseed(uint64_t()))>> : std::true_type {};
+
+// Checks whether two hash functors can be compared with ==.
+template<class Hash, class = void>
+struct IsEqualityComparable : std::false_type {};
+
+template<class Hash>
+struct IsEqualityComparable<Hash, std::void_t<decltype(std::declval<const Hash&>() == std::declval<const Hash&>())>>
+    : std::true_type {};
+
+// Node handle returned by HashMap::extract().
+// HashMap has no nodes of its own, so the handle owns the extracted element itself
+// and gives it back to a hashmap by moving it in HashMap::insert().
+template<class KeyType, class ValueType>
+class NodeHandle {
+  public:
+    NodeHandle() = default;
+
+    explicit NodeHandle(std::pair<KeyType, ValueType> &&element) : element_(std::move(element)) {}
+
+    // O(1)
+    bool empty() const {
+        return !element_.has_value();
+    }
+
+    // O(1)
+    explicit operator bool() const {
+        return !empty();
+    }
+
+    // The handle must not be empty. O(1)
+    KeyType &key() {
+        return element_->first;
+    }
+
+    // The handle must not be empty. O(1)
+    ValueType &mapped() {
+        return element_->second;
+    }
+
+    // Destroys the owned element. O(1)
+    void clear() {
+        element_.reset();
+    }
+
+  private:
+    std::optional<std::pair<KeyType, ValueType>> element_;
+};
+
+// Element of the data storage of HashMap.
+// Iterators hand out std::pair<const KeyType, ValueType> references, as std::unordered_map does, since the index
+// would no longer find an element whose key changed. HashMap itself has to move keys, though: erasing moves the last
+// element into the freed position, and compaction and extract() move elements out. So the element is a union of that
+// pair and std::pair<KeyType, ValueType> of the same layout, and only HashMap moves keys, through mutable_value().
+// This is how node-less maps such as abseil's flat_hash_map move their keys.
+template<class KeyType, class ValueType>
+class StoredElement {
+  public:
+    typedef std::pair<const KeyType, ValueType> value_type;
+    typedef std::pair<KeyType, ValueType> mutable_value_type;
+
+    // Default constructs the key and the value, which load() and build_parallel() then overwrite.
+    StoredElement() : value_() {}
+
+    // Constructs the pair from args.
+    template<class... Args>
+    explicit StoredElement(std::in_place_t, Args&&... args) : value_(std::forward<Args>(args)...) {}
+
+    StoredElement(const StoredElement &other) : value_(other.value_) {}
+
+    // Moves the key too, so that reallocating data storage never copies keys.
+    StoredElement(StoredElement &&other) noexcept(std::is_nothrow_move_constructible<mutable_value_type>::value)
+        : value_(std::move(other.mutable_value().first), std::move(other.mutable_value().second)) {}
+
+    StoredElement &operator=(const StoredElement &other) {
+        mutable_value() = other.value_;
+        return *this;
+    }
+
+    StoredElement &operator=(StoredElement &&other) noexcept(std::is_nothrow_move_assignable<mutable_value_type>::value) {
+        mutable_value() = std::move(other.mutable_value());
+        return *this;
+    }
+
+    ~StoredElement() {
+        value_.~value_type();
+    }
+
+    // O(1)
+    value_type &value() {
+        return value_;
+    }
+
+    // O(1)
+    const value_type &value() const {
+        return value_;
+    }
+
+    // The same element with a mutable key, which must be left equal to the key the index knows the element by,
+    // unless the element is being moved or is forgotten by the index. O(1)
+    mutable_value_type &mutable_value() {
+        return *std::launder(&mutable_value_);
+    }
+
+  private:
+    union {
+        value_type value_;
+        mutable_value_type mutable_value_;
+    };
+};
+
+// Header of the binary snapshots written by HashMap::save(), read by HashMap::load() and served by MappedHashMap.
+// A snapshot consists of the header, the array of element_count std::pair<KeyType, ValueType> exactly as they lie
+// in data storage, and a table of slot_count 64-bit slots. The table is a flat open addressing index, independent
+// of the index policy of the saving map: the home slot of a key is the Fibonacci bucket of its hash,
+// collisions probe linearly, and every slot holds the position of an element plus one, 0 if it is empty.
+// It is at most half full. Both arrays start at offsets aligned to kAlignment, so a mapped file can be used
+// in place. Values are in the byte order of the writing machine, and the hash function must give equal results
+// in the reading process.
+struct SnapshotHeader {
+    static constexpr uint64_t kMagic = 0x0A50414D48534148ull;
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint64_t kAlignment = 64;
+
+    uint64_t magic = kMagic;
+    uint32_t version = kVersion;
+    uint32_t element_size = 0;
+    uint32_t key_size = 0;
+    uint32_t value_size = 0;
+    uint64_t element_count = 0;
+    uint64_t slot_count = 0;
+    uint64_t elements_offset = 0;
+    uint64_t slots_offset = 0;
+
+    // Returns the header of a snapshot of element_count elements. O(log(element_count))
+    template<class KeyType, class ValueType>
+    static SnapshotHeader Make(uint64_t element_count) {
+        SnapshotHeader header;
+        header.element_size = sizeof(std::pair<KeyType, ValueType>);
+        header.key_size = sizeof(KeyType);
+        header.value_size = sizeof(ValueType);
+        header.element_count = element_count;
+        header.slot_count = NextPowerOfTwo(2 * element_count);
+        header.elements_offset = AlignUp(sizeof(SnapshotHeader));
+        header.slots_offset = AlignUp(header.elements_offset + element_count * header.element_size);
+        return header;
+    }
+
+    // Checks whether the header describes a well-formed snapshot of given element type.
+    // Every bound is checked before it is computed, so that a corrupt header cannot wrap the sizes around. O(1)
+    template<class KeyType, class ValueType>
+    bool Matches() const {
+        constexpr uint64_t kMax = std::numeric_limits<uint64_t>::max();
+        if (magic != kMagic || version != kVersion || element_size != sizeof(std::pair<KeyType, ValueType>) ||
+            key_size != sizeof(KeyType) || value_size != sizeof(ValueType)) {
+            return false;
+        }
+        if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0 || element_count > slot_count / 2 ||
+            slot_count > kMax / sizeof(uint64_t) || element_count > kMax / element_size) {
+            return false;
+        }
+        uint64_t elements_size = element_count * element_size;
+        return elements_offset >= sizeof(SnapshotHeader) && elements_offset % kAlignment == 0 &&
+               elements_offset <= kMax - elements_size && slots_offset >= elements_offset + elements_size &&
+               slots_offset % kAlignment == 0 && slots_offset <= kMax - slot_count * sizeof(uint64_t);
+    }
+
+    // Returns the size of the whole snapshot in bytes. O(1)
+    uint64_t Size() const {
+        return slots_offset + slot_count * sizeof(uint64_t);
+    }
+
+    // O(1)
+    static uint64_t AlignUp(uint64_t offset) {
+        return (offset + kAlignment - 1) / kAlignment * kAlignment;
+    }
+};
+
+// HashMap with dense storage and a pluggable index.
+// Operates using two containers:
+// - the index, which maps hashes of keys to indices of data entries in main storage (see index policies above);
+// - the main data storage, implemented with std::vector of StoredElement, which holds std::pair<const KeyType, ValueType>.
+// Both containers, and the nodes of chained indices, allocate memory with the given Allocator.
+// The capacity is chosen by the resize policy (see resize policies above).
+// If kStoreHashes is true, the full hash of every element is kept at the same position of a parallel vector:
+// rebuilding and moving elements reuse it instead of calling the hasher again,
+// and lookups compare it before falling back to KeyEqual. This trades memory for CPU with expensive keys.
+// With IncrementalIndex as the index policy, resizing the index is spread over subsequent insertions and erasures.
+// With a reseedable hash function such as SeededHash, an insertion meeting a probe sequence longer than
+// kMaxProbeLength, the sign of keys chosen to collide, reseeds the hash function and rebuilds the index.
+// The stats policy (see stats policies above) decides which runtime counters stats() reports.
+// The erase policy (see erase policies above) decides whether erasing reorders data storage or leaves holes in it;
+// with holes, iterators are forward iterators skipping them.
+
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class IndexPolicy = ChainedIndex,
+         class ResizePolicy = DefaultResizePolicy, class KeyEqual = std::equal_to<KeyType>, bool kStoreHashes = false,
+         class Allocator = std::allocator<std::pair<const KeyType, ValueType>>, class StatsPolicy = NoStats,
+         class ErasePolicy = SwapErase>
+class HashMap {
+    typedef StoredElement<KeyType, ValueType> Element;
+    typedef std::vector<Element, RebindAllocator<Allocator, Element>> Storage;
+    typedef typename IndexPolicy::template Rebind<Allocator> Index;
+    static constexpr bool kLazyErase = ErasePolicy::kLazy;
+
+  public:
+    typedef typename std::conditional<kLazyErase, SparseIter<KeyType, ValueType, typename Storage::iterator>,
+                                      Iter<KeyType, ValueType, typename Storage::iterator>>::type iterator;
+    typedef typename std::conditional<kLazyErase, SparseIter<KeyType, ValueType, typename Storage::const_iterator>,
+                                      ConstIter<KeyType, ValueType, typename Storage::const_iterator>>::type const_iterator;
+    typedef NodeHandle<KeyType, ValueType> node_type;
+    typedef std::pair<const KeyType, ValueType> value_type;
+    typedef Allocator allocator_type;
+
+    HashMap(const Hash &hasher = Hash(), const Allocator &allocator = Allocator())
+        : HashMap(hasher, KeyEqual(), allocator) {}
+
+    // Constructor with a key comparison functor, for KeyEqual with state.
+    HashMap(const Hash &hasher, const KeyEqual &key_equal, const Allocator &allocator = Allocator())
+        : indices_(capacity_, allocator),
+          hashmap_(RebindAllocator<Allocator, Element>(allocator)),
+          hashes_(RebindAllocator<Allocator, size_t>(allocator)),
+          holes_(RebindAllocator<Allocator, uint8_t>(allocator)),
+          hasher_(hasher), key_equal_(key_equal) {}
+
+    // Constructor from two iterators.
+    // Random access ranges are inserted into a map which is pre-sized for all of their elements.
+    template<class Iterator>
+    HashMap(Iterator first, Iterator last, const Hash &h = Hash(), const Allocator &allocator = Allocator())
+        : HashMap(h, allocator) {
+        if constexpr (std::is_base_of<std::random_access_iterator_tag,
+                                      typename std::iterator_traits<Iterator>::iterator_category>::value) {
+            reserve(static_cast<size_t>(last - first));
+        }
+        while (first != last) {
+            insert(*first);
+            ++first;
+        };
+    };
+
+    // Constructor from initializer list.
+    HashMap(std::initializer_list<std::pair<KeyType, ValueType>> init_list, const Hash &h = Hash(),
+            const Allocator &allocator = Allocator())
+        : HashMap(h, allocator) {
+        reserve(init_list.size());
+        for (const auto &element : init_list) {
+            insert(element);
+        }
+    };
+
+    // Builds a hashmap from a random access range using given number of threads, keeping the first
+    // occurrence of every key, as the constructor from two iterators does.
+    // Keys are hashed in parallel and scattered radix-style into partitions by the top bits of their mixed hash,
+    // which are then deduplicated in parallel, each by a single thread. Data storage is filled directly, in parallel
+    // whenever both key and value are default constructible and copy assignable; the index is filled serially from
+    // the already computed hashes, without any key comparisons. Small ranges use fewer threads.
+    // Time complexity: O(n log n / threads + n) with at most a few equal hashes per key.
+    template<class Iterator>
+    static HashMap build_parallel(Iterator first, Iterator last,
+                                  size_t threads = std::thread::hardware_concurrency(),
+                                  const Hash &h = Hash(), const Allocator &allocator = Allocator()) {
+        static_assert(std::is_base_of<std::random_access_iterator_tag,
+                                      typename std::iterator_traits<Iterator>::iterator_category>::value,
+                      "build_parallel() requires random access iterators");
+        HashMap map(h, allocator);
+        size_t count = static_cast<size_t>(last - first);
+        threads = std::max<size_t>(1, std::min(threads, count / kMinElementsPerThread));
+        size_t partition_count = NextPowerOfTwo(threads * kPartitionsPerThread);
+        int partition_shift = 64;
+        for (size_t partitions = partition_count; partitions > 1; partitions >>= 1) {
+            --partition_shift;
+        }
+        auto partition_of = [partition_shift](size_t hash) -> size_t {
+            return partition_shift == 64 ? 0 : (hash * 11400714819323198485ull) >> partition_shift;
+        };
+        auto chunk_begin = [count, threads](size_t thread) {
+            return count / threads * thread + std::min(thread, count % threads);
+        };
+
+        std::vector<size_t> hashes(count);
+        std::vector<size_t> offsets(threads * partition_count);
+        RunParallel(threads, [&](size_t thread) {
+            size_t *thread_counts = &offsets[thread * partition_count];
+            for (size_t i = chunk_begin(thread); i < chunk_begin(thread + 1); ++i) {
+                hashes[i] = map.GetHash(first[i].first);
+                ++thread_counts[partition_of(hashes[i])];
+            }
+        });
+        // Partition-major, thread-minor prefix sums keep the input order inside every partition.
+        std::vector<size_t> partition_begin(partition_count + 1);
+        size_t offset = 0;
+        for (size_t partition = 0; partition < partition_count; ++partition) {
+            partition_begin[partition] = offset;
+            for (size_t thread = 0; thread < threads; ++thread) {
+                size_t thread_count = offsets[thread * partition_count + partition];
+                offsets[thread * partition_count + partition] = offset;
+                offset += thread_count;
+            }
+        }
+        partition_begin[partition_count] = offset;
+        std::vector<size_t> order(count);
+        RunParallel(threads, [&](size_t thread) {
+            size_t *thread_offsets = &offsets[thread * partition_count];
+            for (size_t i = chunk_begin(thread); i < chunk_begin(thread + 1); ++i) {
+                order[thread_offsets[partition_of(hashes[i])]++] = i;
+            }
+        });
+
+        // Deduplication sorts each partition by hash, every key is then only compared to the kept keys of equal hash.
+        std::vector<size_t> kept(partition_count);
+        RunParallel(threads, [&](size_t thread) {
+            for (size_t partition = thread; partition < partition_count; partition += threads) {
+                size_t *begin = order.data() + partition_begin[partition];
+                size_t *end = order.data() + partition_begin[partition + 1];
+                std::sort(begin, end, [&hashes](size_t lhs, size_t rhs) {
+                    return hashes[lhs] != hashes[rhs] ? hashes[lhs] < hashes[rhs] : lhs < rhs;
+                });
+                size_t *write = begin, *group = begin;
+                for (size_t *read = begin; read != end; ++read) {
+                    if (group == write || hashes[*group] != hashes[*read]) {
+                        group = write;
+                    }
+                    bool duplicate = false;
+                    for (size_t *other = group; other != write && !duplicate; ++other) {
+                        duplicate = map.key_equal_(first[*other].first, first[*read].first);
+                    }
+                    if (!duplicate) {
+                        *write++ = *read;
+                    }
+                }
+                kept[partition] = static_cast<size_t>(write - begin);
+            }
+        });
+
+        std::vector<size_t> storage_begin(partition_count + 1);
+        for (size_t partition = 0; partition < partition_count; ++partition) {
+            storage_begin[partition + 1] = storage_begin[partition] + kept[partition];
+        }
+        size_t total = storage_begin[partition_count];
+        CheckPositionLimit<Index>(total);
+        map.reserve(total);
+        if constexpr (std::is_default_constructible<KeyType>::value && std::is_default_constructible<ValueType>::value &&
+                      std::is_copy_assignable<KeyType>::value && std::is_copy_assignable<ValueType>::value) {
+            map.hashmap_.resize(total);
+            RunParallel(threads, [&](size_t thread) {
+                for (size_t partition = thread; partition < partition_count; partition += threads) {
+                    for (size_t i = 0; i < kept[partition]; ++i) {
+                        map.hashmap_[storage_begin[partition] + i].mutable_value() =
+                            first[order[partition_begin[partition] + i]];
+                    }
+                }
+            });
+        } else {
+            for (size_t partition = 0; partition < partition_count; ++partition) {
+                for (size_t i = 0; i < kept[partition]; ++i) {
+                    map.hashmap_.emplace_back(std::in_place, first[order[partition_begin[partition] + i]]);
+                }
+            }
+        }
+        for (size_t partition = 0; partition < partition_count; ++partition) {
+            for (size_t i = 0; i < kept[partition]; ++i) {
+                size_t hash = hashes[order[partition_begin[partition] + i]];
+                if constexpr (kStoreHashes) {
+                    map.hashes_.push_back(hash);
+                }
+                map.indices_.Insert(hash, storage_begin[partition] + i);
+            }
+        }
+        map.stored_elements_ = total;
+        if constexpr (kLazyErase) {
+            map.holes_.assign(total, 0);
+        }
+        return map;
+    }
+
+    // O(1)
+    iterator begin() {
+        return IteratorAt(first_position_);
+    }
+
+    // O(1)
+    iterator end() {
+        return IteratorAt(stored_elements_);
+    }
+
+    // O(1)
+    const_iterator begin() const {
+        return ConstIteratorAt(first_position_);
+    }
+
+    // O(1)
+    const_iterator end() const {
+        return ConstIteratorAt(stored_elements_);
+    }
+
+    // Splits the elements into at most n contiguous, non-empty ranges of almost equal sizes,
+    // suitable for scanning the hashmap from several threads, OpenMP or TBB.
+    // Time complexity: O(n).
+    std::vector<std::pair<iterator, iterator>> chunks(size_t n) {
+        return ChunksImpl<iterator>([this](size_t position) {
+            return IteratorAt(position);
+        }, n);
+    }
+
+    // Same as above, with constant iterators.
+    // Time complexity: O(n).
+    std::vector<std::pair<const_iterator, const_iterator>> chunks(size_t n) const {
+        return ChunksImpl<const_iterator>([this](size_t position) {
+            return ConstIteratorAt(position);
+        }, n);
+    }
+
+    // Calls fn(key, value) for every element, scanning contiguous chunks of data storage on given number of threads.
+    // fn may modify values, but must not modify the hashmap itself and must be safe to call concurrently.
+    // Time complexity: O(n / threads) plus the time of fn.
+    template<class Function>
+    void for_each_parallel(Function fn, size_t threads = std::thread::hardware_concurrency()) {
+        ForEachParallelImpl(chunks(std::max<size_t>(1, threads)), fn);
+    }
+
+    // Same as above, values are passed as const references.
+    // Time complexity: O(n / threads) plus the time of fn.
+    template<class Function>
+    void for_each_parallel(Function fn, size_t threads = std::thread::hardware_concurrency()) const {
+        ForEachParallelImpl(chunks(std::max<size_t>(1, threads)), fn);
+    }
+
+    // Returns non-const iterator to key if it exists, end() otherwise.
+    // Time complexity: amortized O(1).
+    iterator find(const KeyType &key) {
+        return FindImpl(key);
+    }
+
+    // Heterogeneous version of the above, available if both Hash and KeyEqual are transparent.
+    // Looks up any key comparable with KeyType without constructing a KeyType.
+    // Time complexity: amortized O(1).
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    iterator find(const K &key) {
+        return FindImpl(key);
+    }
+
+    // Returns const iterator to key if it exists, end() otherwise.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    const_iterator find(const KeyType &key) const {
+        return FindImpl(key);
+    }
+
+    // Heterogeneous version of the above, available if both Hash and KeyEqual are transparent.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    const_iterator find(const K &key) const {
+        return FindImpl(key);
+    }
+
+    // Batched lookup. Writes to out an iterator for every key of [first, last): to its element, or end() if there is none.
+    // Keys are processed in batches of kBatchSize: the whole batch is hashed first and the index and data storage
+    // cache lines of every key are prefetched before any of them is resolved, so that memory latency of independent
+    // lookups overlaps. Keys may be of any type find() accepts. Returns the output iterator past the last write.
+    // Time complexity: amortized O(1) per key.
+    template<class KeyIterator, class OutputIterator>
+    OutputIterator find_many(KeyIterator first, KeyIterator last, OutputIterator out) {
+        return FindManyImpl(first, last, out, [this](size_t position) {
+            return position == Index::kNotFound ? end() : IteratorAt(position);
+        });
+    }
+
+    // Same as above, writes constant iterators.
+    // Time complexity: amortized O(1) per key.
+    template<class KeyIterator, class OutputIterator>
+    OutputIterator find_many(KeyIterator first, KeyIterator last, OutputIterator out) const {
+        return FindManyImpl(first, last, out, [this](size_t position) {
+            return position == Index::kNotFound ? end() : ConstIteratorAt(position);
+        });
+    }
+
+    // Returns the number of elements with given key, that is 1 or 0.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    size_t count(const KeyType &key) const {
+        return FindPosition(key) != Index::kNotFound;
+    }
+
+    // Heterogeneous version of the above, available if both Hash and KeyEqual are transparent.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    size_t count(const K &key) const {
+        return FindPosition(key) != Index::kNotFound;
+    }
+
+    // Empties the hashmap.
+    // Time complexity: O(n), where n is the number of elements contained inside the hashmap.
+    void clear() {
+        capacity_ = 0;
+        stored_elements_ = 0;
+        hole_count_ = 0;
+        first_position_ = 0;
+        hashmap_.clear();
+        hashes_.clear();
+        holes_.clear();
+        indices_.Reset(capacity_);
+    }
+
+    // Inserts an element in case there does not already exist one with the same key.
+    // Returns an iterator to the inserted element (or the existing one).
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator insert(const std::pair<KeyType, ValueType> &element) {
+        return try_emplace(element.first, element.second).first;
+    }
+
+    // Same as above, but moves the element into the hashmap.
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator insert(std::pair<KeyType, ValueType> &&element) {
+        return try_emplace(std::move(element.first), std::move(element.second)).first;
+    }
+
+    // Inserts the elements of [first, last) whose keys are not present yet, see insert_many().
+    // Unless the iterators are single pass, the hashmap is reserved for all of the elements once,
+    // so inserting them never rebuilds it.
+    // Time complexity: amortized O(1) per element.
+    template<class Iterator, class = std::enable_if_t<std::is_base_of<std::input_iterator_tag,
+                                 typename std::iterator_traits<Iterator>::iterator_category>::value>>
+    void insert(Iterator first, Iterator last) {
+        if constexpr (std::is_base_of<std::forward_iterator_tag,
+                                      typename std::iterator_traits<Iterator>::iterator_category>::value) {
+            Presize(size() + static_cast<size_t>(std::distance(first, last)));
+        }
+        insert_many(first, last);
+    }
+
+    // Inserts an element with given key and a value constructed in place from args,
+    // in case there does not already exist one with the same key. Otherwise neither key nor args are touched.
+    // Returns an iterator to the inserted element (or the existing one) and whether the insertion took place.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType &key, Args&&... args) {
+        return EmplaceImpl(key, std::forward<Args>(args)...);
+    }
+
+    // Same as above, but moves the key into the hashmap.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType &&key, Args&&... args) {
+        return EmplaceImpl(std::move(key), std::forward<Args>(args)...);
+    }
+
+    // Inserts an element constructed from key and value if there is no element with this key.
+    // The value is only constructed when the insertion takes place.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class K, class V>
+    std::pair<iterator, bool> emplace(K &&key, V &&value) {
+        return EmplaceImpl(KeyType(std::forward<K>(key)), std::forward<V>(value));
+    }
+
+    // Inserts an element constructed from args if there is no element with the same key.
+    // The element has to be constructed to learn its key, it is then moved into the hashmap.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        std::pair<KeyType, ValueType> element(std::forward<Args>(args)...);
+        return EmplaceImpl(std::move(element.first), std::move(element.second));
+    }
+
+    // Assigns value to the element with given key, or inserts a new element if there is none.
+    // Returns an iterator to the element and whether the insertion took place.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class V>
+    std::pair<iterator, bool> insert_or_assign(const KeyType &key, V &&value) {
+        return AssignImpl(key, std::forward<V>(value));
+    }
+
+    // Same as above, but moves the key into the hashmap if the insertion takes place.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class V>
+    std::pair<iterator, bool> insert_or_assign(KeyType &&key, V &&value) {
+        return AssignImpl(std::move(key), std::forward<V>(value));
+    }
+
+    // Erases an element by key if there exists one, otherwise does nothing.
+    // Time complexity: amortized O(1), individual query O(n).
+    void erase(const KeyType &key) {
+        EraseImpl(key);
+    }
+
+    // Heterogeneous version of the above, available if both Hash and KeyEqual are transparent.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    void erase(const K &key) {
+        EraseImpl(key);
+    }
+
+    // Batched insertion of the elements of [first, last), see find_many().
+    // Random access ranges are reserved for up front.
+    // Time complexity: amortized O(1) per element.
+    template<class Iterator>
+    void insert_many(Iterator first, Iterator last) {
+        if constexpr (std::is_base_of<std::random_access_iterator_tag,
+                                      typename std::iterator_traits<Iterator>::iterator_category>::value) {
+            Presize(size() + static_cast<size_t>(last - first));
+        }
+        ForEachBatch(first, last, [](const auto &element) -> const auto & {
+            return element.first;
+        }, [this](const auto &element, size_t hash) {
+            EmplaceWithHash(hash, element.first, element.second);
+        });
+    }
+
+    // Batched erasure of the keys of [first, last), see find_many().
+    // Time complexity: amortized O(1) per key.
+    template<class KeyIterator>
+    void erase_many(KeyIterator first, KeyIterator last) {
+        ForEachBatch(first, last, [](const auto &key) -> const auto & {
+            return key;
+        }, [this](const auto &key, size_t hash) {
+            EraseWithHash(key, hash);
+        });
+    }
+
+    // Erases every element for which pred(element) returns true and returns the number of erased elements.
+    // Data storage is compacted in a single stable pass and the index is rebuilt once afterwards, which beats
+    // erasing the elements one by one when many of them go. Holes left by lazy erasure are compacted away too.
+    // If pred throws, the elements it has not been called for are kept and the exception is rethrown.
+    // Time complexity: O(n + capacity).
+    template<class Predicate>
+    size_t erase_if(Predicate pred) {
+        size_t old_size = size();
+        CompactIf([this, &pred](size_t position) {
+            return pred(static_cast<const value_type&>(hashmap_[position].value()));
+        });
+        return old_size - size();
+    }
+
+    // Removes the holes left by lazy erasure, moving the remaining elements down in their order,
+    // and rebuilds the index. Does nothing if there are no holes.
+    // Time complexity: O(n + capacity) if there are holes, O(1) otherwise.
+    void compact() {
+        if (hole_count_ != 0) {
+            CompactIf([](size_t) {
+                return false;
+            });
+        }
+    }
+
+    // Moves the elements of source whose keys are not present yet into the hashmap, leaving the others in source,
+    // as std::unordered_map::merge() does. The hashmap is reserved for all of source once, elements are moved
+    // rather than copied, and keys are hashed at most once: not at all if the hash functions are equal
+    // (stateless, or comparing equal like SeededHash) and source stores hashes. If the hashmap is empty
+    // and the hash functions and allocators are equal, it takes over the data storage and the index of source,
+    // along with the state describing them: the hash function, the reseed history and the stats.
+    // Source is compacted in a single pass and its index rebuilt once, or released if it ends up empty.
+    // Time complexity: amortized O(1) per element of source, plus O(capacity) of source, O(1) when taking over.
+    void merge(HashMap &source) {
+        if (&source == this || source.empty()) {
+            return;
+        }
+        if (stored_elements_ == 0 && SameHash(hasher_, source.hasher_) && get_allocator() == source.get_allocator()) {
+            std::swap(capacity_, source.capacity_);
+            std::swap(stored_elements_, source.stored_elements_);
+            std::swap(hole_count_, source.hole_count_);
+            std::swap(first_position_, source.first_position_);
+            std::swap(indices_, source.indices_);
+            hashmap_.swap(source.hashmap_);
+            hashes_.swap(source.hashes_);
+            holes_.swap(source.holes_);
+            if constexpr (IsReseedable<Hash>::value) {
+                std::swap(hasher_, source.hasher_);
+            }
+            std::swap(reseed_count_, source.reseed_count_);
+            std::swap(reseed_size_, source.reseed_size_);
+            std::swap(stats_, source.stats_);
+            return;
+        }
+        Presize(size() + source.size());
+        // Checked for every element, since an insertion may reseed the hash function of the hashmap.
+        source.CompactIf([this, &source](size_t position) {
+            auto &element = source.hashmap_[position].mutable_value();
+            size_t hash = SameHash(hasher_, source.hasher_) ? source.GetStoredHash(position) : GetHash(element.first);
+            return EmplaceWithHash(hash, std::move(element.first), std::move(element.second)).second;
+        });
+    }
+
+    // Same as above for a temporary source.
+    // Time complexity: see above.
+    void merge(HashMap &&source) {
+        merge(source);
+    }
+
+    // Erases the elements whose keys are not in other and returns the number of erased elements.
+    // other is any container whose count(key) accepts KeyType, such as a HashMap with another value type or a set.
+    // For a hashmap of this very type with an equal hash function and stored hashes, keys are not hashed again.
+    // Data storage is compacted in a single pass and the index rebuilt once, see erase_if().
+    // Time complexity: O(n + capacity) plus n lookups in other.
+    template<class Other>
+    size_t intersect(const Other &other) {
+        if (static_cast<const void*>(&other) == this) {
+            return 0;
+        }
+        return EraseByMembership(other, false);
+    }
+
+    // Erases the elements whose keys are in other and returns the number of erased elements, see intersect().
+    // Time complexity: O(n + capacity) plus n lookups in other.
+    template<class Other>
+    size_t difference(const Other &other) {
+        if (static_cast<const void*>(&other) == this) {
+            size_t old_size = size();
+            clear();
+            return old_size;
+        }
+        return EraseByMembership(other, true);
+    }
+
+    // Returns the number of holes left by lazy erasure, which compact() would remove. O(1)
+    size_t hole_count() const {
+        return hole_count_;
+    }
+
+    // Erases the element pointed to by given iterator, which must be dereferenceable.
+    // The position of the element is already known, so no lookup is made.
+    // Returns an iterator to the element following the erased one in iteration order.
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator erase(iterator position) {
+        return EraseAt(static_cast<size_t>(position.base() - hashmap_.begin()));
+    }
+
+    // Same as above for a constant iterator.
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator erase(const_iterator position) {
+        return EraseAt(static_cast<size_t>(position.base() - hashmap_.cbegin()));
+    }
+
+    // Removes the element pointed to by given iterator from the hashmap and returns a node handle owning it.
+    // Time complexity: amortized O(1), individual query O(n).
+    node_type extract(const_iterator position) {
+        return ExtractAt(static_cast<size_t>(position.base() - hashmap_.cbegin()));
+    }
+
+    // Removes the element with given key from the hashmap and returns a node handle owning it.
+    // Returns an empty node handle if there is no such element.
+    // Time complexity: amortized O(1), individual query O(n).
+    node_type extract(const KeyType &key) {
+        size_t position = FindPosition(key);
+        if (position == Index::kNotFound) {
+            return node_type();
+        }
+        return ExtractAt(position);
+    }
+
+    // Moves the element owned by given node handle into the hashmap, unless there is already one with the same key,
+    // in which case the handle keeps its element. Returns an iterator to the element with this key, end() if the handle is empty.
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator insert(node_type &&node) {
+        if (node.empty()) {
+            return end();
+        }
+        auto result = try_emplace(std::move(node.key()), std::move(node.mapped()));
+        if (result.second) {
+            node.clear();
+        }
+        return result.first;
+    }
+
+    // Returns number of elements contained inside the hashmap. O(1)
+    size_t size() const {
+        return stored_elements_ - hole_count_;
+    }
+
+    // Checks if the hashmap contains no elements. O(1)
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // If there already exists an element with given key, returns a non-const iterator pointing to it.
+    // Otherwise, inserts a new entry with this key and default value to the hashmap.
+    // Time complexity: amortized O(1), individual query O(n).
+    ValueType &operator[](const KeyType &key) {
+        return try_emplace(key).first->second;
+    }
+
+    // Same as above, but moves the key into the hashmap if the insertion takes place.
+    // Time complexity: amortized O(1), individual query O(n).
+    ValueType &operator[](KeyType &&key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    // If there exists an element with given key, returns a constant iterator pointing to it.
+    // Otherwise, throws the std::out_of_range() exception.
+    // Time complexity: amortized O(1), individual query expected O(1) provided the hash function is good enough.
+    const ValueType &at(const KeyType &key) const {
+        return AtImpl(key);
+    }
+
+    // Heterogeneous version of the above, available if both Hash and KeyEqual are transparent.
+    // Time complexity: amortized O(1), individual query expected O(1) provided the hash function is good enough.
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    const ValueType &at(const K &key) const {
+        return AtImpl(key);
+    }
+
+    // Pre-sizes the hashmap so that n elements can be stored without rebuilding it.
+    // Never reduces capacity.
+    // Time complexity: O(n + capacity) if the hashmap has to be rebuilt, O(1) otherwise.
+    void reserve(size_t n) {
+        if (n == 0) {
+            return;
+        }
+        Resize(resize_policy_.ReserveCapacity(n, capacity_));
+        hashmap_.reserve(hole_count_ + n);
+        if constexpr (kStoreHashes) {
+            hashes_.reserve(hole_count_ + n);
+        }
+        if constexpr (kLazyErase) {
+            holes_.reserve(hole_count_ + n);
+        }
+    }
+
+    // Sets capacity to at least n, or to the smallest one holding all current elements if that is larger.
+    // Time complexity: O(n + capacity).
+    void rehash(size_t n) {
+        Resize(resize_policy_.ReserveCapacity(size(), n));
+    }
+
+    // Returns the current capacity, the number of buckets the index is sized for, 0 before the first insertion. O(1)
+    size_t bucket_count() const {
+        return capacity_;
+    }
+
+    // Returns the average number of elements per bucket. O(1)
+    float load_factor() const {
+        return capacity_ == 0 ? 0.0f : static_cast<float>(size()) / static_cast<float>(capacity_);
+    }
+
+    // Reduces capacity as far as the resize policy allows for the current number of elements.
+    // Time complexity: O(n + capacity).
+    void shrink_to_fit() {
+        if (hole_count_ != 0) {
+            compact();
+        }
+        Resize(resize_policy_.FitCapacity(stored_elements_, capacity_));
+        hashmap_.shrink_to_fit();
+        hashes_.shrink_to_fit();
+        holes_.shrink_to_fit();
+    }
+
+    // Writes a binary snapshot of the hashmap to given stream, see SnapshotHeader for the format.
+    // Only available for trivially copyable keys and values. Throws std::runtime_error if writing fails.
+    // Time complexity: O(n).
+    void save(std::ostream &out) const {
+        static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                      "snapshots require trivially copyable keys and values");
+        static_assert(sizeof(Element) == sizeof(std::pair<KeyType, ValueType>), "elements are stored as plain pairs");
+        // Holes are left out of the snapshot, so the elements are written one by one if there are any.
+        SnapshotHeader header = SnapshotHeader::Make<KeyType, ValueType>(size());
+        std::vector<uint64_t> slots(header.slot_count);
+        FibonacciBucketMapping mapping;
+        mapping.Reset(header.slot_count);
+        for (size_t position = 0, written = 0; position < stored_elements_; ++position) {
+            if (IsHole(position)) {
+                continue;
+            }
+            size_t slot = mapping.Bucket(GetStoredHash(position));
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & (header.slot_count - 1);
+            }
+            slots[slot] = ++written;
+        }
+        const char padding[SnapshotHeader::kAlignment] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(padding, static_cast<std::streamsize>(header.elements_offset - sizeof(header)));
+        if (hole_count_ == 0) {
+            out.write(reinterpret_cast<const char*>(hashmap_.data()),
+                      static_cast<std::streamsize>(size() * header.element_size));
+        } else {
+            for (size_t position = 0; position < stored_elements_; ++position) {
+                if (!IsHole(position)) {
+                    out.write(reinterpret_cast<const char*>(&hashmap_[position]),
+                              static_cast<std::streamsize>(header.element_size));
+                }
+            }
+        }
+        out.write(padding, static_cast<std::streamsize>(
+            header.slots_offset - header.elements_offset - size() * header.element_size));
+        out.write(reinterpret_cast<const char*>(slots.data()),
+                  static_cast<std::streamsize>(header.slot_count * sizeof(uint64_t)));
+        if (!out) {
+            throw std::runtime_error("HashMap::save: write failed");
+        }
+    }
+
+    // Replaces the contents of the hashmap with a snapshot written by save(), leaving the stream right after it.
+    // Elements are read in bulk and the index is rebuilt from them without any key comparisons,
+    // so snapshots are trusted not to contain duplicate keys.
+    // Throws std::runtime_error, leaving the hashmap empty, if the stream holds no snapshot of this element type.
+    // Time complexity: O(n).
+    void load(std::istream &in) {
+        static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                      "snapshots require trivially copyable keys and values");
+        static_assert(std::is_default_constructible<KeyType>::value && std::is_default_constructible<ValueType>::value,
+                      "snapshots are read into default constructed elements");
+        clear();
+        SnapshotHeader header;
+        in.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!in || !header.Matches<KeyType, ValueType>() ||
+            header.Size() > static_cast<uint64_t>(std::numeric_limits<std::streamsize>::max())) {
+            throw std::runtime_error("HashMap::load: not a snapshot of this map type");
+        }
+        CheckPositionLimit<Index>(header.element_count);
+        in.ignore(static_cast<std::streamsize>(header.elements_offset - sizeof(header)));
+        // The element count of the header is not trusted with an allocation: storage grows one chunk at a time,
+        // so a truncated or forged snapshot runs out of data before storage outgrows what the stream holds.
+        const size_t chunk_elements = std::max<size_t>(1, kSnapshotChunkBytes / header.element_size);
+        while (in && hashmap_.size() < header.element_count) {
+            size_t loaded = hashmap_.size();
+            size_t count = std::min<size_t>(chunk_elements, header.element_count - loaded);
+            hashmap_.resize(loaded + count);
+            in.read(reinterpret_cast<char*>(hashmap_.data() + loaded),
+                    static_cast<std::streamsize>(count * header.element_size));
+        }
+        in.ignore(static_cast<std::streamsize>(header.Size() - header.elements_offset -
+                                               header.element_count * header.element_size));
+        if (!in) {
+            clear();
+            throw std::runtime_error("HashMap::load: truncated snapshot");
+        }
+        stored_elements_ = hashmap_.size();
+        if constexpr (kLazyErase) {
+            holes_.assign(stored_elements_, 0);
+        }
+        if constexpr (kStoreHashes) {
+            hashes_.reserve(stored_elements_);
+            for (const auto &element : hashmap_) {
+                hashes_.push_back(GetHash(element.value().first));
+            }
+        }
+        // The index is empty, so it is filled directly instead of through Rebuild(), even if it is incremental.
+        capacity_ = resize_policy_.ReserveCapacity(stored_elements_, 1);
+        indices_.Reset(capacity_);
+        for (size_t position = 0; position < stored_elements_; ++position) {
+            indices_.Insert(GetStoredHash(position), position);
+        }
+    }
+
+    // Reports the probe length distribution, bucket occupancy, hash collisions and memory usage,
+    // computed by scanning the hashmap, along with the counters maintained by the stats policy.
+    // Time complexity: O(n log n + capacity), plus n lookups.
+    HashMapStats stats() const {
+        HashMapStats result;
+        result.size = size();
+        result.bucket_count = capacity_;
+        size_t total_probes = 0;
+        std::vector<size_t> hashes, occupancy(capacity_ != 0 ? indices_.BucketCount() : 0);
+        hashes.reserve(size());
+        for (size_t position = 0; position < stored_elements_; ++position) {
+            if (IsHole(position)) {
+                continue;
+            }
+            hashes.push_back(GetStoredHash(position));
+            size_t &bucket_occupancy = occupancy[indices_.HomeBucket(GetStoredHash(position))];
+            result.max_bucket_occupancy = std::max(result.max_bucket_occupancy, ++bucket_occupancy);
+            size_t probes = 0;
+            indices_.Find(GetStoredHash(position), [&probes, position](size_t candidate) {
+                ++probes;
+                return candidate == position;
+            });
+            if (probes >= result.probe_length_histogram.size()) {
+                result.probe_length_histogram.resize(probes + 1);
+            }
+            ++result.probe_length_histogram[probes];
+            result.max_probe_length = std::max(result.max_probe_length, probes);
+            total_probes += probes;
+        }
+        std::sort(hashes.begin(), hashes.end());
+        size_t colliding = 0;
+        for (size_t begin = 0, end = 0; begin < hashes.size(); begin = end) {
+            while (end < hashes.size() && hashes[end] == hashes[begin]) {
+                ++end;
+            }
+            colliding += end - begin > 1 ? end - begin : 0;
+        }
+        if (size() != 0) {
+            result.mean_probe_length = static_cast<double>(total_probes) / static_cast<double>(size());
+            result.hash_collision_rate = static_cast<double>(colliding) / static_cast<double>(size());
+        }
+        result.reseed_count = reseed_count_;
+        if constexpr (StatsPolicy::kEnabled) {
+            result.rebuild_count = stats_.rebuild_count;
+            result.rebuild_time = stats_.rebuild_time;
+        }
+        result.storage_bytes = hashmap_.capacity() * sizeof(typename Storage::value_type);
+        result.hashes_bytes = hashes_.capacity() * sizeof(size_t);
+        result.holes_bytes = holes_.capacity() * sizeof(uint8_t);
+        result.index_bytes = indices_.MemoryUsage();
+        return result;
+    }
+
+    // O(1)
+    Hash hash_function() const {
+        return hasher_;
+    }
+
+    // O(1)
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+    // O(1)
+    allocator_type get_allocator() const {
+        return allocator_type(hashmap_.get_allocator());
+    }
+
+  private:
+    // Number of keys batched operations hash and prefetch ahead of resolving them.
+    static constexpr size_t kBatchSize = 16;
+    // Largest number of bytes load() allocates for elements ahead of reading them.
+    static constexpr size_t kSnapshotChunkBytes = 1 << 20;
+    // Smallest number of elements build_parallel() gives to a thread, and number of partitions per thread.
+    static constexpr size_t kMinElementsPerThread = 4096;
+    static constexpr size_t kPartitionsPerThread = 4;
+    // An insertion comparing more candidates than this reseeds a reseedable hash function.
+    // That many collisions are practically impossible with a good hash function and a load the resize policy allows.
+    static constexpr size_t kMaxProbeLength = 64;
+
+    // Capacity 0 means the index has not been allocated yet, which only happens while the hashmap is empty:
+    // constructing and clearing a hashmap allocates nothing, the first insertion allocates the index.
+    // stored_elements_ counts the positions of data storage, holes left by lazy erasure included.
+    // first_position_ is the position of the first element, after the holes erasing the oldest elements has left.
+    size_t capacity_ = 0, stored_elements_ = 0, hole_count_ = 0, first_position_ = 0;
+
+    Index indices_;
+    Storage hashmap_;
+    // Hashes of the keys in hashmap_, only filled if kStoreHashes is true.
+    std::vector<size_t, RebindAllocator<Allocator, size_t>> hashes_;
+    // Hole flags of the positions in hashmap_, only filled if the erase policy is lazy.
+    std::vector<uint8_t, RebindAllocator<Allocator, uint8_t>> holes_;
+    Hash hasher_;
+    KeyEqual key_equal_;
+    ResizePolicy resize_policy_;
+    StatsPolicy stats_;
+    // Number of reseeds of the hash function, and the size of the hashmap at the last one.
+    size_t reseed_count_ = 0, reseed_size_ = 0;
+
+    // Rebuilds the index according to its new capacity.
+    // Data storage is left untouched: only the positions of the stored elements are recorded again,
+    // so no element is copied and no duplicate checks are made.
+    // With an IncrementalIndex only starts the migration, which is then continued by AdvanceMigration().
+    // Time complexity: O(n + capacity).
+    void Rebuild() {
+        typename StatsPolicy::RebuildTimer timer(stats_);
+        RebuildIndex(indices_, capacity_, hashmap_.size(), PositionHasher(), HoleChecker());
+    }
+
+    // Reseeds the hash function with a random seed, then hashes all keys again and rebuilds the index.
+    // Keys chosen to collide under the old seed are scattered by the new one. Does nothing unless the hashmap
+    // has doubled since the last reseed, so a hash function which reseeding does not help costs amortized O(1).
+    // The holes of lazy erasure are not hashed, their keys may have been moved out by extract().
+    // Time complexity: O(n + capacity).
+    void Reseed() {
+        if (size() < 2 * reseed_size_) {
+            return;
+        }
+        reseed_size_ = size();
+        ++reseed_count_;
+        hasher_.reseed(RandomSeed());
+        if constexpr (kStoreHashes) {
+            for (size_t position = 0; position < stored_elements_; ++position) {
+                if (!IsHole(position)) {
+                    hashes_[position] = GetHash(hashmap_[position].value().first);
+                }
+            }
+        }
+        typename StatsPolicy::RebuildTimer timer(stats_);
+        Reindex();
+    }
+
+    // Resets the index and records the positions of all elements again, also with an IncrementalIndex,
+    // which is needed whenever positions change wholesale.
+    // Time complexity: O(n + capacity).
+    void Reindex() {
+        ResetIndex(indices_, capacity_, hashmap_.size(), PositionHasher(), HoleChecker());
+    }
+
+    // O(1)
+    bool IsHole(size_t position) const {
+        if constexpr (kLazyErase) {
+            return holes_[position] != 0;
+        } else {
+            (void)position;
+            return false;
+        }
+    }
+
+    // Returns an iterator to the element at given position of data storage,
+    // with lazy erasure to the first element at or after it.
+    // O(1), with lazy erasure amortized O(1).
+    iterator IteratorAt(size_t position) {
+        if constexpr (kLazyErase) {
+            return iterator(hashmap_.begin() + position, hashmap_.end(), holes_.data() + position);
+        } else {
+            return iterator(hashmap_.begin() + position);
+        }
+    }
+
+    // O(1), with lazy erasure amortized O(1).
+    const_iterator ConstIteratorAt(size_t position) const {
+        if constexpr (kLazyErase) {
+            return const_iterator(hashmap_.begin() + position, hashmap_.end(), holes_.data() + position);
+        } else {
+            return const_iterator(hashmap_.begin() + position);
+        }
+    }
+
+    // Lets an IncrementalIndex migrate a bounded number of slots, does nothing for other index policies.
+    // Time complexity: O(1).
+    void AdvanceMigration() {
+        AdvanceIndex(indices_, PositionHasher());
+    }
+
+    // Returns a function computing the hash of the key stored at given position of data storage.
+    auto PositionHasher() const {
+        return [this](size_t position) {
+            return GetStoredHash(position);
+        };
+    }
+
+    // Returns a function telling whether given position of data storage is a hole.
+    auto HoleChecker() const {
+        return [this](size_t position) {
+            return IsHole(position);
+        };
+    }
+
+    // Returns position of given key in data storage, Index::kNotFound if there is none.
+    // K is either KeyType or, with transparent functors, any type comparable with it.
+    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
+    template<class K>
+    size_t FindPosition(const K &key) const {
+        return FindPosition(key, GetHash(key));
+    }
+
+    // Same as above for a key whose hash is already known.
+    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
+    template<class K>
+    size_t FindPosition(const K &key, size_t hash) const {
+        size_t probes = 0;
+        return FindPosition(key, hash, probes);
+    }
+
+    // Same as above, also adding the number of compared candidates to probes.
+    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
+    template<class K>
+    size_t FindPosition(const K &key, size_t hash, size_t &probes) const {
+        if (capacity_ == 0) {
+            return Index::kNotFound;
+        }
+        return indices_.Find(hash, [this, &key, hash, &probes](size_t position) {
+            ++probes;
+            if constexpr (kStoreHashes) {
+                if (hashes_[position] != hash) {
+                    return false;
+                }
+            }
+            return key_equal_(hashmap_[position].value().first, key);
+        });
+    }
+
+    // Helper function for find().
+    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
+    template<class K>
+    iterator FindImpl(const K &key) {
+        size_t position = FindPosition(key);
+        if (position == Index::kNotFound) {
+            return end();
+        }
+        return IteratorAt(position);
+    }
+
+    // Helper function for find() const.
+    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
+    template<class K>
+    const_iterator FindImpl(const K &key) const {
+        size_t position = FindPosition(key);
+        if (position == Index::kNotFound) {
+            return end();
+        }
+        return ConstIteratorAt(position);
+    }
+
+    // Helper function for at().
+    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
+    template<class K>
+    const ValueType &AtImpl(const K &key) const {
+        const_iterator key_position = FindImpl(key);
+        if (key_position == end()) {
+            throw std::out_of_range("Key not found");
+        }
+        return key_position->second;
     }
 
-    // O(1)
-    iterator end() {
-        return iterator(hashmap_.end());
+    // Helper function for erase(). The key is hashed only once.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class K>
+    void EraseImpl(const K &key) {
+        EraseWithHash(key, GetHash(key));
     }
 
-    // O(1)
-    const_iterator begin() const {
-        return const_iterator(hashmap_.begin());
+    // Same as above for a key whose hash is already known.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class K>
+    void EraseWithHash(const K &key, size_t hash) {
+        size_t position = FindPosition(key, hash);
+        if (position == Index::kNotFound) {
+            return;
+        }
+        EraseAt(position, hash);
     }
 
-    // O(1)
-    const_iterator end() const {
-        return const_iterator(hashmap_.end());
+    // Helper function. Erases the element at given position of data storage.
+    // Returns an iterator to the same position, which now holds the element previously stored last,
+    // with lazy erasure to the next element.
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator EraseAt(size_t position) {
+        return EraseAt(position, GetStoredHash(position));
     }
 
-    // Returns non-const iterator to key if it exists, end() otherwise.
-    // Time complexity: amortized O(1).
-    iterator find(KeyType key) {
-        if (capacity_ == 0) {
-            return end();
-        }
-        size_t candidate_position = GetBucketIndex(key);
-        for (const auto &element : indices_[candidate_position]) {
-            if (hashmap_[element].first == key) {
-                return iterator(hashmap_.begin() + element);
+    // Same as above for an element whose hash is already known.
+    // The element itself is not accessed, so it may already have been moved from.
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator EraseAt(size_t position, size_t hash) {
+        indices_.Erase(hash, position);
+        if constexpr (kLazyErase) {
+            holes_[position] = 1;
+            ++hole_count_;
+            while (first_position_ < stored_elements_ && holes_[first_position_] != 0) {
+                ++first_position_;
+            }
+            DownscaleIfNecessary();
+            AdvanceMigration();
+            if (ErasePolicy::ShouldCompact(size(), hole_count_)) {
+                // Compaction moves elements, the next element is the first one stored after the survivors before it.
+                size_t survivors = 0;
+                for (size_t i = 0; i < position; ++i) {
+                    survivors += !IsHole(i);
+                }
+                compact();
+                return IteratorAt(survivors);
             }
+            return IteratorAt(position);
+        }
+        SwapWithLastIfNecessary(position);
+        hashmap_.pop_back();
+        if constexpr (kStoreHashes) {
+            hashes_.pop_back();
         }
-        return end();
+        --stored_elements_;
+        DownscaleIfNecessary();
+        AdvanceMigration();
+        return IteratorAt(position);
     }
 
-    // Returns const iterator to key if it exists, end() otherwise.
-    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
-    const_iterator find(const KeyType &key) const {
-        if (capacity_ == 0) {
-            return end();
-        }
-        size_t candidate_position = GetBucketIndex(key);
-        for (const auto &element : indices_[candidate_position]) {
-            if (hashmap_[element].first == key) {
-                return const_iterator(hashmap_.begin() + element);
-            }
-        }
-        return end();
+    // Helper function for extract(). Moves the element at given position out of data storage.
+    // Time complexity: amortized O(1), individual query O(n).
+    node_type ExtractAt(size_t position) {
+        size_t hash = GetStoredHash(position);
+        node_type node(std::move(hashmap_[position].mutable_value()));
+        EraseAt(position, hash);
+        return node;
     }
 
-    // Empties the hashmap.
-    // Time complexity: O(n), where n is the number of elements contained inside the hashmap.
-    void clear() {
-        capacity_ = 1;
-        stored_elements_ = 0;
-        hashmap_.clear();
-        indices_.clear();
-        indices_.resize(capacity_);
+    // Helper function for all insertions. Looks the key up and, if it is absent,
+    // constructs the new element directly at the end of data storage.
+    // The key is hashed only once.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class K, class... Args>
+    std::pair<iterator, bool> EmplaceImpl(K &&key, Args&&... args) {
+        size_t hash = GetHash(key);
+        return EmplaceWithHash(hash, std::forward<K>(key), std::forward<Args>(args)...);
     }
 
-    // Inserts an element in case there does not already exist one with the same key.
-    // Returns an iterator to the inserted element (or the existing one).
+    // Same as above for a key whose hash is already known.
     // Time complexity: amortized O(1), individual query O(n).
-    iterator insert(const std::pair<KeyType, ValueType> &element) {
-        auto key_position = find(element.first);
-        if (key_position != end()) {
-            return key_position;
+    template<class K, class... Args>
+    std::pair<iterator, bool> EmplaceWithHash(size_t hash, K &&key, Args&&... args) {
+        size_t probes = 0;
+        size_t position = FindPosition(key, hash, probes);
+        if (position != Index::kNotFound) {
+            return {IteratorAt(position), false};
         }
+        CheckPositionLimit<Index>(stored_elements_ + 1);
         UpscaleIfNecessary();
+        hashmap_.emplace_back(std::in_place, std::piecewise_construct,
+                              std::forward_as_tuple(std::forward<K>(key)),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+        if constexpr (kStoreHashes) {
+            hashes_.push_back(hash);
+        }
+        if constexpr (kLazyErase) {
+            holes_.push_back(0);
+        }
         ++stored_elements_;
-        size_t pos = GetBucketIndex(element.first);
-        indices_[pos].push_back(stored_elements_ - 1);
-        hashmap_.push_back(element);
-        return iterator(hashmap_.begin() + stored_elements_ - 1);
+        indices_.Insert(hash, stored_elements_ - 1);
+        AdvanceMigration();
+        if (indices_.ShouldRehash()) {
+            typename StatsPolicy::RebuildTimer timer(stats_);
+            Reindex();
+        }
+        if constexpr (IsReseedable<Hash>::value) {
+            if (probes > kMaxProbeLength) {
+                Reseed();
+            }
+        }
+        return {IteratorAt(stored_elements_ - 1), true};
     }
 
-    // Erases an element by key if there exists one, otherwise does nothing.
-    // Time complexity: amortized O(1), individual query O(n).
-    void erase(const KeyType &key) {
-        iterator key_position = find(key);
-        if (key_position == end()) {
-            return;
+    // Helper function for find_many(). make(position) turns a position, or Index::kNotFound, into the written iterator.
+    // Time complexity: amortized O(1) per key.
+    template<class KeyIterator, class OutputIterator, class MakeIterator>
+    OutputIterator FindManyImpl(KeyIterator first, KeyIterator last, OutputIterator out, MakeIterator make) const {
+        size_t hashes[kBatchSize];
+        while (first != last) {
+            KeyIterator batch_start = first;
+            size_t count = 0;
+            for (; first != last && count < kBatchSize; ++first, ++count) {
+                hashes[count] = GetHash(*first);
+                if (capacity_ != 0) {
+                    indices_.Prefetch(hashes[count]);
+                }
+            }
+            for (size_t i = 0; i < count && capacity_ != 0; ++i) {
+                size_t candidate = indices_.Peek(hashes[i]);
+                if (candidate != Index::kNotFound) {
+                    PrefetchAddress(&hashmap_[candidate]);
+                }
+            }
+            for (size_t i = 0; i < count; ++i, ++batch_start) {
+                *out = make(FindPosition(*batch_start, hashes[i]));
+                ++out;
+            }
         }
-        EraseLastElement(SwapWithLastIfNecessary(key));
-        --stored_elements_;
-        DownscaleIfNecessary();
+        return out;
     }
 
-    // Returns number of elements contained inside the hashmap. O(1)
-    size_t size() const {
-        return stored_elements_;
+    // Helper function for batched modifications. Hashes batches of kBatchSize elements of [first, last),
+    // prefetches their index cache lines, then calls process(element, hash) for each of them in order.
+    // key_of(element) returns the key of an element.
+    // Time complexity: O(last - first) plus the time of process().
+    template<class Iterator, class KeyOf, class Process>
+    void ForEachBatch(Iterator first, Iterator last, KeyOf key_of, Process process) {
+        size_t hashes[kBatchSize];
+        while (first != last) {
+            Iterator batch_start = first;
+            size_t count = 0, reseeds = reseed_count_;
+            for (; first != last && count < kBatchSize; ++first, ++count) {
+                hashes[count] = GetHash(key_of(*first));
+                if (capacity_ != 0) {
+                    indices_.Prefetch(hashes[count]);
+                }
+            }
+            for (size_t i = 0; i < count; ++i, ++batch_start) {
+                // A reseed by an insertion of this batch invalidates the hashes computed ahead.
+                if (reseed_count_ != reseeds) {
+                    hashes[i] = GetHash(key_of(*batch_start));
+                }
+                process(*batch_start, hashes[i]);
+            }
+        }
     }
 
-    // Checks if the hashmap contains no elements. O(1)
-    bool empty() const {
-        return size() == 0;
+    // Helper function for chunks(). Splits the positions of data storage, iterator_at(position) makes the bounds.
+    // With lazy erasure a range of positions may only hold holes, such chunks are left out.
+    // Time complexity: O(n), with lazy erasure O(number of positions).
+    template<class Iterator, class IteratorAt>
+    std::vector<std::pair<Iterator, Iterator>> ChunksImpl(IteratorAt iterator_at, size_t n) const {
+        std::vector<std::pair<Iterator, Iterator>> result;
+        n = std::min(n, stored_elements_);
+        result.reserve(n);
+        for (size_t chunk = 0; chunk < n; ++chunk) {
+            size_t chunk_begin = stored_elements_ / n * chunk + std::min(chunk, stored_elements_ % n);
+            size_t chunk_end = stored_elements_ / n * (chunk + 1) + std::min(chunk + 1, stored_elements_ % n);
+            Iterator first = iterator_at(chunk_begin), last = iterator_at(chunk_end);
+            if (first != last) {
+                result.emplace_back(first, last);
+            }
+        }
+        return result;
     }
 
-    // If there already exists an element with given key, returns a non-const iterator pointing to it.
-    // Otherwise, inserts a new entry with this key and default value to the hashmap.
-    // Time complexity: amortized O(1), individual query O(n).
-    ValueType &operator[](const KeyType &key) {
-        return insert({key, ValueType()})->second;
+    // Helper function for for_each_parallel(), runs a thread per chunk.
+    // Time complexity: O(n / chunks.size()) plus the time of fn.
+    template<class Chunks, class Function>
+    static void ForEachParallelImpl(const Chunks &chunks, Function &fn) {
+        RunParallel(chunks.size(), [&chunks, &fn](size_t chunk) {
+            for (auto it = chunks[chunk].first; it != chunks[chunk].second; ++it) {
+                fn(it->first, it->second);
+            }
+        });
     }
 
-    // If there exists an element with given key, returns a constant iterator pointing to it.
-    // Otherwise, throws the std::out_of_range() exception.
-    // Time complexity: amortized O(1), individual query expected O(1) provided the hash function is good enough.
-    const ValueType &at(const KeyType &key) const {
-        const_iterator key_position = find(key);
-        if (key_position == end()) {
-            throw std::out_of_range("Key not found");
+    // Runs task(thread) for every thread in [0, threads), the calling thread taking thread 0.
+    // Rethrows the first exception thrown by any task once all of them are finished.
+    // Time complexity: the time of the slowest task.
+    template<class Task>
+    static void RunParallel(size_t threads, Task task) {
+        if (threads == 0) {
+            return;
+        }
+        std::vector<std::exception_ptr> errors(threads);
+        auto guarded = [&errors, &task](size_t thread) {
+            try {
+                task(thread);
+            } catch (...) {
+                errors[thread] = std::current_exception();
+            }
+        };
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        for (size_t thread = 1; thread < threads; ++thread) {
+            workers.emplace_back(guarded, thread);
+        }
+        guarded(0);
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        for (const auto &error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
         }
-        return key_position->second;
     }
 
-    // O(1)
-    Hash hash_function() const {
-        return hasher_;
+    // Helper function for insert_or_assign(). The key is hashed only once.
+    // EmplaceWithHash() leaves value untouched if the key is present, it is then assigned from.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class K, class V>
+    std::pair<iterator, bool> AssignImpl(K &&key, V &&value) {
+        size_t hash = GetHash(key);
+        auto result = EmplaceWithHash(hash, std::forward<K>(key), std::forward<V>(value));
+        if (!result.second) {
+            result.first->second = std::forward<V>(value);
+        }
+        return result;
     }
 
-  private:
-
-    size_t capacity_ = 1, stored_elements_ = 0;
-
-    std::vector<std::list<size_t>> indices_ = std::vector<std::list<size_t>>(capacity_);
-    std::vector<std::pair<KeyType, ValueType>> hashmap_;
-    Hash hasher_;
+    // Helper function. Moves the last element of data storage to given position, unless it is already there.
+    // The element at given position must already be forgotten by the index.
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    void SwapWithLastIfNecessary(size_t position) {
+        size_t last_position = hashmap_.size() - 1;
+        if (position == last_position) {
+            return;
+        }
+        indices_.Replace(GetStoredHash(last_position), last_position, position);
+        std::swap(hashmap_[position], hashmap_[last_position]);
+        if constexpr (kStoreHashes) {
+            hashes_[position] = hashes_[last_position];
+        }
+    }
 
-    // Rebuilds and resizes hashmap according to its new capacity.
-    void Rebuild() {
-        std::vector<std::pair<KeyType, ValueType>> old_hashmap;
-        old_hashmap = hashmap_;
-        stored_elements_ = 0;
-        hashmap_.clear();
-        indices_.clear();
-        indices_.resize(capacity_);
-        for (auto element : old_hashmap) {
-            insert(element);
+    // Helper function for erase_if(), compact() and the set operations. Moves the elements which are neither holes
+    // nor dropped by pred(position) down to the front of data storage, keeping their order, drops the rest,
+    // then shrinks capacity as far as the resize policy would by erasing and rebuilds the index once,
+    // also with an IncrementalIndex. If no element is kept, the index is released as by clear().
+    // pred may move the element it drops away. Once pred throws, all remaining elements are kept.
+    // Time complexity: O(n + capacity) plus the time of pred.
+    template<class Predicate>
+    void CompactIf(Predicate pred) {
+        std::exception_ptr error;
+        size_t kept = 0;
+        for (size_t position = 0; position < stored_elements_; ++position) {
+            if (IsHole(position)) {
+                continue;
+            }
+            if (!error) {
+                try {
+                    if (pred(position)) {
+                        continue;
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            if (kept != position) {
+                hashmap_[kept] = std::move(hashmap_[position]);
+                if constexpr (kStoreHashes) {
+                    hashes_[kept] = hashes_[position];
+                }
+            }
+            ++kept;
+        }
+        if (kept == 0 && stored_elements_ != 0) {
+            clear();
+        } else if (kept != stored_elements_) {
+            hashmap_.erase(hashmap_.begin() + kept, hashmap_.end());
+            if constexpr (kStoreHashes) {
+                hashes_.resize(kept);
+            }
+            if constexpr (kLazyErase) {
+                holes_.assign(kept, 0);
+            }
+            stored_elements_ = kept;
+            hole_count_ = 0;
+            first_position_ = 0;
+            size_t capacity = resize_policy_.ShrinkCapacity(kept, capacity_);
+            while (capacity != capacity_) {
+                capacity_ = capacity;
+                capacity = resize_policy_.ShrinkCapacity(kept, capacity_);
+            }
+            typename StatsPolicy::RebuildTimer timer(stats_);
+            Reindex();
+        }
+        if (error) {
+            std::rethrow_exception(error);
         }
     }
 
-    // Helper function. Erases an element if it is last in data storage.
-    // Time complexity: O(1).
-    void EraseLastElement(std::list<size_t>::iterator iter) {
-        size_t chain_storage_location = GetBucketIndex(LastKey());
-        indices_[chain_storage_location].erase(iter);
-        hashmap_.pop_back();
+    // Helper function for intersect() and difference(), erases the elements whose keys are in other
+    // if contained is true, the elements whose keys are not in other otherwise.
+    // Time complexity: O(n + capacity) plus n lookups in other.
+    template<class Other>
+    size_t EraseByMembership(const Other &other, bool contained) {
+        size_t old_size = size();
+        CompactIf([this, &other, contained](size_t position) {
+            if constexpr (std::is_same<Other, HashMap>::value) {
+                if (SameHash(hasher_, other.hasher_)) {
+                    return (other.FindPosition(hashmap_[position].value().first, GetStoredHash(position)) !=
+                            Index::kNotFound) == contained;
+                }
+            }
+            return (other.count(hashmap_[position].value().first) != 0) == contained;
+        });
+        return old_size - size();
     }
 
-    // Helper function. Swaps given element with last in data storage
-    // Returns iterator pointing to last element in chain storage.
-    // Time complexity: amortized O(1), expected O(1) provided if hash function is good enough.
-    std::list<size_t>::iterator SwapWithLastIfNecessary(const KeyType &key) {
-        auto it_key = FindInChainList(key);
-        if (LastKey() == key) {
-            return it_key;
+    // Checks whether hashes computed by one hash function are valid for the other:
+    // stateless hash functions always hash alike, others if they compare equal.
+    // O(1)
+    static bool SameHash(const Hash &lhs, const Hash &rhs) {
+        if constexpr (std::is_empty<Hash>::value) {
+            return true;
+        } else if constexpr (IsEqualityComparable<Hash>::value) {
+            return lhs == rhs;
+        } else {
+            (void)lhs;
+            (void)rhs;
+            return false;
         }
-        auto it_last = FindInChainList(LastKey());
-        std::swap(*it_last, *it_key);
-        std::swap(hashmap_[*it_key], hashmap_[*it_last]);
-        return it_key;
     }
 
-    // Returns a list iterator pointing to the position in the chain list
-    // where the index of given key is recorded.
-    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
-    std::list<size_t>::iterator FindInChainList(const KeyType &key) {
-        size_t chain_storage_location = GetBucketIndex(key);
-        auto it = indices_[chain_storage_location].begin();
-        while (*it >= stored_elements_ || hashmap_[*it].first != key) {
-            ++it;
+    // Helper function for bulk insertions. Sizes the index for n elements as reserve() does, but grows data storage
+    // geometrically, so that a sequence of bulk insertions still moves every element amortized O(1) times.
+    // Time complexity: O(n + capacity) if the hashmap has to be rebuilt, O(1) otherwise.
+    void Presize(size_t n) {
+        if (n == 0) {
+            return;
+        }
+        Resize(resize_policy_.ReserveCapacity(n, capacity_));
+        size_t storage = hole_count_ + n;
+        if (storage > hashmap_.capacity()) {
+            storage = std::max(storage, 2 * hashmap_.capacity());
+            hashmap_.reserve(storage);
+            if constexpr (kStoreHashes) {
+                hashes_.reserve(storage);
+            }
+            if constexpr (kLazyErase) {
+                holes_.reserve(storage);
+            }
         }
-        return it;
     }
 
     // Checks if capacity needs to be decreased, and in case it does, performs this.
     // Time complexity: O(1) amortized, O(n) individual query.
     void DownscaleIfNecessary() {
-        if (stored_elements_ * kMinLoadFactor <= capacity_) {
-            capacity_ /= kScalingFactor;
-            Rebuild();
-        }
+        Resize(resize_policy_.ShrinkCapacity(size(), capacity_));
     }
 
     // Checks if capacity needs to be increased, and in case it does, performs this.
     // Time complexity: O(1) amortized, O(n) individual query.
     void UpscaleIfNecessary() {
-        if (stored_elements_ >= capacity_ * kMaxLoadFactor) {
-            capacity_ *= kScalingFactor;
+        Resize(resize_policy_.GrowCapacity(size(), std::max<size_t>(capacity_, 1)));
+    }
+
+    // Rebuilds the hashmap with given capacity unless it is the current one.
+    // Time complexity: O(1) if capacity does not change, O(n + capacity) otherwise.
+    void Resize(size_t capacity) {
+        if (capacity != capacity_) {
+            capacity_ = capacity;
             Rebuild();
         }
     }
 
-    // Returns index of chain, where given element could be located.
+    // Returns hash of given key, which the index reduces to its own bucket range.
     // Time complexity: O(1).
-    size_t GetBucketIndex(const KeyType& key) const {
-        return hasher_(key) % capacity_;
+    template<class K>
+    size_t GetHash(const K &key) const {
+        return hasher_(key);
     }
 
-    // Returns constant reference to last key in the data storage.
+    // Returns hash of the key stored at given position of data storage, without hashing it again if hashes are stored.
     // Time complexity: O(1).
-    const KeyType& LastKey() const {
-        return hashmap_.back().first;
+    size_t GetStoredHash(size_t position) const {
+        if constexpr (kStoreHashes) {
+            return hashes_[position];
+        } else {
+            return GetHash(hashmap_[position].value().first);
+        }
     }
 };
 
+// HashMap allocating all of its memory from a std::pmr::memory_resource, such as std::pmr::monotonic_buffer_resource or Arena.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class IndexPolicy = ChainedIndex>
+using PmrHashMap = HashMap<KeyType, ValueType, Hash, IndexPolicy, DefaultResizePolicy, std::equal_to<KeyType>, false,
+                           std::pmr::polymorphic_allocator<std::pair<const KeyType, ValueType>>>;
+
 
-// ForwardIterator for HashMap.
+// RandomAccessIterator for HashMap.
 // Implemented with std::vector<> iterators.
 // Allows to iterate over the hash map in linear time, accessing elements in arbitrary order.
-template<class KeyType, class ValueType>
+// Random access lets the dense storage be split for parallel scans, e.g. with std::for_each(std::execution::par, ...).
+// Dereferencing yields a reference to the stored std::pair<const KeyType, ValueType>, see StoredElement.
+template<class KeyType, class ValueType, class StorageIterator>
 class Iter {
   public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef std::pair<const KeyType, ValueType> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef value_type *pointer;
+    typedef value_type &reference;
+
     Iter() = default;
 
-    Iter(typename std::vector<std::pair<KeyType, ValueType>>::iterator iter) {
+    Iter(StorageIterator iter) {
         iter_ = iter;
     }
 
     // O(1)
-    std::pair<const KeyType, ValueType> operator*() {
-        return *iter_;
+    reference operator*() const {
+        return iter_->value();
     }
 
     // O(1)
-    std::pair<const KeyType, ValueType> *operator->() {
-        return reinterpret_cast<std::pair<const KeyType, ValueType>*>(&*iter_);
+    pointer operator->() const {
+        return &iter_->value();
     }
 
     // O(1)
@@ -299,28 +3130,114 @@ class Iter {
         return copy_iter;
     }
 
+    // O(1)
+    Iter operator--() {
+        --iter_;
+        return *this;
+    }
+
+    // O(1)
+    Iter operator--(int) {
+        Iter copy = *this;
+        --*this;
+        return copy;
+    }
+
+    // O(1)
+    Iter &operator+=(difference_type n) {
+        iter_ += n;
+        return *this;
+    }
+
+    // O(1)
+    Iter &operator-=(difference_type n) {
+        iter_ -= n;
+        return *this;
+    }
+
+    // O(1)
+    Iter operator+(difference_type n) const {
+        return Iter(iter_ + n);
+    }
+
+    // O(1)
+    friend Iter operator+(difference_type n, Iter iter) {
+        return iter + n;
+    }
+
+    // O(1)
+    Iter operator-(difference_type n) const {
+        return Iter(iter_ - n);
+    }
+
+    // O(1)
+    difference_type operator-(Iter other) const {
+        return iter_ - other.iter_;
+    }
+
+    // O(1)
+    reference operator[](difference_type n) const {
+        return *(*this + n);
+    }
+
+    // O(1)
+    bool operator<(Iter other) const {
+        return iter_ < other.iter_;
+    }
+
+    // O(1)
+    bool operator>(Iter other) const {
+        return iter_ > other.iter_;
+    }
+
+    // O(1)
+    bool operator<=(Iter other) const {
+        return iter_ <= other.iter_;
+    }
+
+    // O(1)
+    bool operator>=(Iter other) const {
+        return iter_ >= other.iter_;
+    }
+
+    // Returns the underlying iterator into data storage. O(1)
+    StorageIterator base() const {
+        return iter_;
+    }
+
   private:
-    typename std::vector<std::pair<KeyType, ValueType>>::iterator iter_;
+    StorageIterator iter_;
 };
 
-// Constant version of the ForwardIterator for HashMap.
-template<class KeyType, class ValueType>
+// Constant version of the RandomAccessIterator for HashMap.
+template<class KeyType, class ValueType, class StorageConstIterator>
 class ConstIter {
   public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef std::pair<const KeyType, ValueType> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type *pointer;
+    typedef const value_type &reference;
+
     ConstIter() = default;
 
-    ConstIter(typename std::vector<std::pair<KeyType, ValueType>>::const_iterator const_iter) {
+    ConstIter(StorageConstIterator const_iter) {
         const_iter_ = const_iter;
     }
 
+    template<class StorageIterator,
+             class = std::enable_if_t<!std::is_same<StorageIterator, StorageConstIterator>::value &&
+                                      std::is_convertible<StorageIterator, StorageConstIterator>::value>>
+    ConstIter(Iter<KeyType, ValueType, StorageIterator> iter) : const_iter_(iter.base()) {}
+
     // O(1)
-    const std::pair<const KeyType, ValueType> operator*() const {
-        return *const_iter_;
+    reference operator*() const {
+        return const_iter_->value();
     }
 
     // O(1)
-    const std::pair<const KeyType, ValueType> *operator->() const {
-        return reinterpret_cast<const std::pair<const KeyType, ValueType>*>(&*const_iter_);
+    pointer operator->() const {
+        return &const_iter_->value();
     }
 
     // O(1)
@@ -346,6 +3263,164 @@ class ConstIter {
         return copy_const_iter;
     }
 
+    // O(1)
+    ConstIter operator--() {
+        --const_iter_;
+        return *this;
+    }
+
+    // O(1)
+    ConstIter operator--(int) {
+        ConstIter copy = *this;
+        --*this;
+        return copy;
+    }
+
+    // O(1)
+    ConstIter &operator+=(difference_type n) {
+        const_iter_ += n;
+        return *this;
+    }
+
+    // O(1)
+    ConstIter &operator-=(difference_type n) {
+        const_iter_ -= n;
+        return *this;
+    }
+
+    // O(1)
+    ConstIter operator+(difference_type n) const {
+        return ConstIter(const_iter_ + n);
+    }
+
+    // O(1)
+    friend ConstIter operator+(difference_type n, ConstIter iter) {
+        return iter + n;
+    }
+
+    // O(1)
+    ConstIter operator-(difference_type n) const {
+        return ConstIter(const_iter_ - n);
+    }
+
+    // O(1)
+    difference_type operator-(ConstIter other) const {
+        return const_iter_ - other.const_iter_;
+    }
+
+    // O(1)
+    reference operator[](difference_type n) const {
+        return *(*this + n);
+    }
+
+    // O(1)
+    bool operator<(ConstIter other) const {
+        return const_iter_ < other.const_iter_;
+    }
+
+    // O(1)
+    bool operator>(ConstIter other) const {
+        return const_iter_ > other.const_iter_;
+    }
+
+    // O(1)
+    bool operator<=(ConstIter other) const {
+        return const_iter_ <= other.const_iter_;
+    }
+
+    // O(1)
+    bool operator>=(ConstIter other) const {
+        return const_iter_ >= other.const_iter_;
+    }
+
+    // Returns the underlying iterator into data storage. O(1)
+    StorageConstIterator base() const {
+        return const_iter_;
+    }
+
+  private:
+    StorageConstIterator const_iter_;
+};
+
+// ForwardIterator for HashMap with a lazy erase policy.
+// Walks data storage like Iter and ConstIter, skipping the holes left by erased elements,
+// so advancing is amortized O(1) as long as holes are compacted before they outnumber the elements.
+// StorageIterator is a non-const or const std::vector<> iterator, the non-const form converts to the const one.
+template<class KeyType, class ValueType, class StorageIterator>
+class SparseIter {
+    static constexpr bool kConst = std::is_const<
+        std::remove_reference_t<typename std::iterator_traits<StorageIterator>::reference>>::value;
+
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::pair<const KeyType, ValueType> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef typename std::conditional<kConst, const value_type*, value_type*>::type pointer;
+    typedef typename std::conditional<kConst, const value_type&, value_type&>::type reference;
+
+    SparseIter() = default;
+
+    // Points to the first element at or after iter, hole points to the hole flag of iter.
+    SparseIter(StorageIterator iter, StorageIterator end, const uint8_t *hole) : iter_(iter), end_(end), hole_(hole) {
+        SkipHoles();
+    }
+
+    template<class OtherIterator, class = std::enable_if_t<!std::is_same<OtherIterator, StorageIterator>::value &&
+                                                           std::is_convertible<OtherIterator, StorageIterator>::value>>
+    SparseIter(const SparseIter<KeyType, ValueType, OtherIterator> &other)
+        : iter_(other.iter_), end_(other.end_), hole_(other.hole_) {}
+
+    // O(1)
+    reference operator*() const {
+        return iter_->value();
+    }
+
+    // O(1)
+    pointer operator->() const {
+        return &iter_->value();
+    }
+
+    // O(1)
+    bool operator==(const SparseIter &other) const {
+        return iter_ == other.iter_;
+    }
+
+    // O(1)
+    bool operator!=(const SparseIter &other) const {
+        return iter_ != other.iter_;
+    }
+
+    // Amortized O(1)
+    SparseIter &operator++() {
+        ++iter_;
+        ++hole_;
+        SkipHoles();
+        return *this;
+    }
+
+    // Amortized O(1)
+    SparseIter operator++(int) {
+        SparseIter copy = *this;
+        ++*this;
+        return copy;
+    }
+
+    // Returns the underlying iterator into data storage. O(1)
+    StorageIterator base() const {
+        return iter_;
+    }
+
   private:
-    typename std::vector<std::pair<KeyType, ValueType>>::const_iterator const_iter_;
+    template<class, class, class> friend class SparseIter;
+
+    StorageIterator iter_, end_;
+    const uint8_t *hole_ = nullptr;
+
+    // Time complexity: O(number of skipped holes).
+    void SkipHoles() {
+        while (iter_ != end_ && *hole_ != 0) {
+            ++iter_;
+            ++hole_;
+        }
+    }
 };
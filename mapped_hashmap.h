@@ -0,0 +1,174 @@
+#pragma once
+
+#include<cerrno>
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<stdexcept>
+#include<string>
+#include<system_error>
+#include<type_traits>
+#include<utility>
+
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+#include"hashmap.h"
+
+// Read-only hashmap served straight from a memory-mapped snapshot file written by HashMap::save().
+// Nothing is deserialized: lookups probe the flat slot table of the snapshot and compare keys in the mapped
+// element array, see SnapshotHeader for the layout. The mapping is shared, so every process mapping the same file
+// uses a single copy of it in the page cache, and pages are only read from disk once they are touched.
+// The file must not be modified while it is mapped. POSIX only.
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class KeyEqual = std::equal_to<KeyType>>
+class MappedHashMap {
+  public:
+    typedef std::pair<KeyType, ValueType> value_type;
+    typedef const value_type *const_iterator;
+    typedef const_iterator iterator;
+
+    static_assert(std::is_trivially_copyable<KeyType>::value && std::is_trivially_copyable<ValueType>::value,
+                  "snapshots require trivially copyable keys and values");
+    static_assert(alignof(value_type) <= SnapshotHeader::kAlignment, "elements are aligned to SnapshotHeader::kAlignment");
+
+    // Maps given snapshot file. Throws std::system_error if the file cannot be mapped,
+    // std::runtime_error if it holds no snapshot of this element type.
+    explicit MappedHashMap(const std::string &path, const Hash &hasher = Hash(), const KeyEqual &key_equal = KeyEqual())
+        : hasher_(hasher), key_equal_(key_equal) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "MappedHashMap: open " + path);
+        }
+        struct stat file_stat;
+        if (::fstat(fd, &file_stat) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "MappedHashMap: fstat " + path);
+        }
+        size_ = static_cast<size_t>(file_stat.st_size);
+        if (size_ < sizeof(SnapshotHeader)) {
+            ::close(fd);
+            throw std::runtime_error("MappedHashMap: " + path + " is not a snapshot");
+        }
+        void *data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        int error = errno;
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            throw std::system_error(error, std::generic_category(), "MappedHashMap: mmap " + path);
+        }
+        data_ = data;
+        const auto *header = static_cast<const SnapshotHeader*>(data_);
+        if (!header->Matches<KeyType, ValueType>() || header->Size() > size_) {
+            Unmap();
+            throw std::runtime_error("MappedHashMap: " + path + " is not a snapshot of this map type");
+        }
+        const char *bytes = static_cast<const char*>(data_);
+        elements_ = reinterpret_cast<const value_type*>(bytes + header->elements_offset);
+        slots_ = reinterpret_cast<const uint64_t*>(bytes + header->slots_offset);
+        element_count_ = header->element_count;
+        slot_mask_ = header->slot_count - 1;
+        mapping_.Reset(header->slot_count);
+    }
+
+    MappedHashMap(const MappedHashMap &) = delete;
+    MappedHashMap &operator=(const MappedHashMap &) = delete;
+
+    MappedHashMap(MappedHashMap &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedHashMap &operator=(MappedHashMap &&other) noexcept {
+        if (this != &other) {
+            Unmap();
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+            std::swap(elements_, other.elements_);
+            std::swap(slots_, other.slots_);
+            std::swap(element_count_, other.element_count_);
+            std::swap(slot_mask_, other.slot_mask_);
+            std::swap(mapping_, other.mapping_);
+            std::swap(hasher_, other.hasher_);
+            std::swap(key_equal_, other.key_equal_);
+        }
+        return *this;
+    }
+
+    ~MappedHashMap() {
+        Unmap();
+    }
+
+    // O(1)
+    const_iterator begin() const {
+        return elements_;
+    }
+
+    // O(1)
+    const_iterator end() const {
+        return elements_ + element_count_;
+    }
+
+    // O(1)
+    size_t size() const {
+        return element_count_;
+    }
+
+    // O(1)
+    bool empty() const {
+        return element_count_ == 0;
+    }
+
+    // Finds the element with given key, returns end() if there is none.
+    // The slot table is not validated up front, which would read the whole file, so every probed slot is checked
+    // instead: throws std::runtime_error on a slot pointing past the elements, and probes every slot at most once.
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    const_iterator find(const KeyType &key) const {
+        size_t slot = mapping_.Bucket(hasher_(key));
+        for (size_t probes = 0; probes <= slot_mask_ && slots_[slot] != 0; ++probes) {
+            if (slots_[slot] > element_count_) {
+                throw std::runtime_error("MappedHashMap: corrupt slot table");
+            }
+            const value_type *element = elements_ + (slots_[slot] - 1);
+            if (key_equal_(element->first, key)) {
+                return element;
+            }
+            slot = (slot + 1) & slot_mask_;
+        }
+        return end();
+    }
+
+    // Returns the number of elements with given key, that is 1 or 0.
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    size_t count(const KeyType &key) const {
+        return find(key) != end();
+    }
+
+    // Returns the value of the element with given key, throws std::out_of_range if there is none.
+    // Time complexity: expected O(1), provided the hash function is good enough.
+    const ValueType &at(const KeyType &key) const {
+        const_iterator it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("Key not found");
+        }
+        return it->second;
+    }
+
+  private:
+    void *data_ = nullptr;
+    size_t size_ = 0;
+    const value_type *elements_ = nullptr;
+    const uint64_t *slots_ = nullptr;
+    size_t element_count_ = 0, slot_mask_ = 0;
+    FibonacciBucketMapping mapping_;
+    Hash hasher_;
+    KeyEqual key_equal_;
+
+    // O(1)
+    void Unmap() {
+        if (data_ != nullptr) {
+            ::munmap(data_, size_);
+            data_ = nullptr;
+        }
+    }
+};
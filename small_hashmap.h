@@ -0,0 +1,331 @@
+#pragma once
+
+#include<cstddef>
+#include<functional>
+#include<initializer_list>
+#include<memory>
+#include<new>
+#include<stdexcept>
+#include<tuple>
+#include<type_traits>
+#include<utility>
+
+#include"hashmap.h"
+
+// HashMap with inline storage for small sizes. https://en.wikipedia.org/wiki/Small_object_optimization
+// The first kInlineCapacity elements live in a buffer inside the object and are searched linearly with KeyEqual,
+// without hashing them and without any allocation. Inserting one more element promotes the map:
+// all elements are moved into a heap allocated HashMap, which is then used until clear().
+// Erasing never demotes a promoted map, so a workload oscillating around kInlineCapacity does not move elements back and forth.
+// Both layouts are contiguous arrays of the StoredElement of HashMap, so the iterators are those of HashMap,
+// yielding std::pair<const KeyType, ValueType> references, and, as in HashMap, erasing an element moves the last one
+// into its place.
+template<class KeyType, class ValueType, size_t kInlineCapacity = 8, class Hash = std::hash<KeyType>,
+         class IndexPolicy = ChainedIndex, class KeyEqual = std::equal_to<KeyType>>
+class SmallHashMap {
+    typedef StoredElement<KeyType, ValueType> Element;
+
+  public:
+    typedef HashMap<KeyType, ValueType, Hash, IndexPolicy, DefaultResizePolicy, KeyEqual> map_type;
+    typedef std::pair<const KeyType, ValueType> value_type;
+    typedef Iter<KeyType, ValueType, Element*> iterator;
+    typedef ConstIter<KeyType, ValueType, const Element*> const_iterator;
+
+    static_assert(kInlineCapacity > 0, "inline capacity must be positive");
+
+    explicit SmallHashMap(const Hash &hasher = Hash(), const KeyEqual &key_equal = KeyEqual())
+        : hasher_(hasher), key_equal_(key_equal) {}
+
+    SmallHashMap(std::initializer_list<value_type> init_list, const Hash &hasher = Hash(),
+                 const KeyEqual &key_equal = KeyEqual())
+        : SmallHashMap(hasher, key_equal) {
+        for (const auto &element : init_list) {
+            insert(element);
+        }
+    }
+
+    // Time complexity: O(n).
+    SmallHashMap(const SmallHashMap &other) : hasher_(other.hasher_), key_equal_(other.key_equal_) {
+        CopyFrom(other);
+    }
+
+    // Time complexity: O(kInlineCapacity), O(1) for a promoted map.
+    SmallHashMap(SmallHashMap &&other) noexcept(std::is_nothrow_move_constructible<Element>::value)
+        : hasher_(other.hasher_), key_equal_(other.key_equal_) {
+        MoveFrom(std::move(other));
+    }
+
+    // Time complexity: O(n).
+    SmallHashMap &operator=(const SmallHashMap &other) {
+        if (this != &other) {
+            clear();
+            hasher_ = other.hasher_;
+            key_equal_ = other.key_equal_;
+            CopyFrom(other);
+        }
+        return *this;
+    }
+
+    // Time complexity: O(n + kInlineCapacity).
+    SmallHashMap &operator=(SmallHashMap &&other) noexcept(std::is_nothrow_move_constructible<Element>::value) {
+        if (this != &other) {
+            clear();
+            hasher_ = other.hasher_;
+            key_equal_ = other.key_equal_;
+            MoveFrom(std::move(other));
+        }
+        return *this;
+    }
+
+    ~SmallHashMap() {
+        DestroyInline();
+    }
+
+    // Returns whether the elements are still stored inline. O(1)
+    bool is_inline() const {
+        return large_ == nullptr;
+    }
+
+    // O(1)
+    iterator begin() {
+        return iterator(Data());
+    }
+
+    // O(1)
+    iterator end() {
+        return begin() + size();
+    }
+
+    // O(1)
+    const_iterator begin() const {
+        return const_iterator(Data());
+    }
+
+    // O(1)
+    const_iterator end() const {
+        return begin() + size();
+    }
+
+    // O(1)
+    size_t size() const {
+        return large_ ? large_->size() : inline_size_;
+    }
+
+    // O(1)
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Finds the element with given key, returns end() if there is none.
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    iterator find(const KeyType &key) {
+        return begin() + FindPosition(key);
+    }
+
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    const_iterator find(const KeyType &key) const {
+        return begin() + FindPosition(key);
+    }
+
+    // Returns the number of elements with given key, that is 1 or 0.
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    size_t count(const KeyType &key) const {
+        return FindPosition(key) != size();
+    }
+
+    // Returns the value of the element with given key, throws std::out_of_range if there is none.
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    ValueType &at(const KeyType &key) {
+        return const_cast<ValueType&>(static_cast<const SmallHashMap&>(*this).at(key));
+    }
+
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    const ValueType &at(const KeyType &key) const {
+        size_t position = FindPosition(key);
+        if (position == size()) {
+            throw std::out_of_range("Key not found");
+        }
+        return Data()[position].value().second;
+    }
+
+    // Returns the value of the element with given key, inserting a default constructed one if there is none.
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    ValueType &operator[](const KeyType &key) {
+        return try_emplace(key).first->second;
+    }
+
+    // Inserts an element in case there does not already exist one with the same key.
+    // Returns an iterator to the inserted element (or the existing one).
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    iterator insert(const value_type &element) {
+        return try_emplace(element.first, element.second).first;
+    }
+
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    iterator insert(value_type &&element) {
+        return try_emplace(std::move(element.first), std::move(element.second)).first;
+    }
+
+    // Constructs the value from args in case there does not already exist an element with the same key.
+    // Returns an iterator to the element and whether it was inserted.
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    template<class K, class... Args>
+    std::pair<iterator, bool> try_emplace(K &&key, Args&&... args) {
+        if (large_) {
+            auto result = large_->try_emplace(std::forward<K>(key), std::forward<Args>(args)...);
+            return {begin() + (result.first - large_->begin()), result.second};
+        }
+        size_t position = FindPosition(key);
+        if (position != inline_size_) {
+            return {begin() + position, false};
+        }
+        if (inline_size_ == kInlineCapacity) {
+            Promote();
+            auto result = large_->try_emplace(std::forward<K>(key), std::forward<Args>(args)...);
+            return {begin() + (result.first - large_->begin()), true};
+        }
+        ::new (static_cast<void*>(InlineData() + inline_size_))
+            Element(std::in_place, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                    std::forward_as_tuple(std::forward<Args>(args)...));
+        return {begin() + inline_size_++, true};
+    }
+
+    // Inserts an element, or assigns the value of the existing element with the same key.
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    template<class V>
+    std::pair<iterator, bool> insert_or_assign(const KeyType &key, V &&value) {
+        auto result = try_emplace(key, std::forward<V>(value));
+        if (!result.second) {
+            result.first->second = std::forward<V>(value);
+        }
+        return result;
+    }
+
+    // Erases the element with given key, if there is one.
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    void erase(const KeyType &key) {
+        size_t position = FindPosition(key);
+        if (position != size()) {
+            erase(begin() + position);
+        }
+    }
+
+    // Erases the element pointed to by given iterator, which must be dereferenceable.
+    // Returns an iterator to the same position, which now holds the element previously stored last.
+    // Time complexity: O(1) while inline, then amortized O(1).
+    iterator erase(const_iterator position) {
+        size_t offset = static_cast<size_t>(position.base() - Data());
+        if (large_) {
+            large_->erase(large_->begin() + offset);
+            return begin() + offset;
+        }
+        Element *elements = InlineData();
+        if (offset != inline_size_ - 1) {
+            elements[offset] = std::move(elements[inline_size_ - 1]);
+        }
+        elements[--inline_size_].~Element();
+        return begin() + offset;
+    }
+
+    // Empties the map and returns it to inline storage, releasing the promoted HashMap.
+    // Time complexity: O(n).
+    void clear() {
+        DestroyInline();
+        large_.reset();
+    }
+
+  private:
+    // Inline elements are constructed in place, so the buffer is raw storage.
+    alignas(Element) unsigned char buffer_[kInlineCapacity * sizeof(Element)];
+    size_t inline_size_ = 0;
+    std::unique_ptr<map_type> large_;
+    Hash hasher_;
+    KeyEqual key_equal_;
+
+    // O(1)
+    Element *InlineData() {
+        return std::launder(reinterpret_cast<Element*>(buffer_));
+    }
+
+    // O(1)
+    const Element *InlineData() const {
+        return std::launder(reinterpret_cast<const Element*>(buffer_));
+    }
+
+    // Returns the start of the array holding the elements, which the iterators wrap. O(1)
+    Element *Data() {
+        return const_cast<Element*>(static_cast<const SmallHashMap&>(*this).Data());
+    }
+
+    // O(1)
+    const Element *Data() const {
+        if (!large_) {
+            return InlineData();
+        }
+        return large_->empty() ? nullptr : &*large_->begin().base();
+    }
+
+    // Returns position of given key, size() if there is none.
+    // Time complexity: O(kInlineCapacity) while inline, then amortized O(1).
+    size_t FindPosition(const KeyType &key) const {
+        if (large_) {
+            auto it = large_->find(key);
+            return static_cast<size_t>(it - large_->begin());
+        }
+        const Element *elements = InlineData();
+        for (size_t position = 0; position < inline_size_; ++position) {
+            if (key_equal_(elements[position].value().first, key)) {
+                return position;
+            }
+        }
+        return inline_size_;
+    }
+
+    // Moves all inline elements into a new HashMap.
+    // Time complexity: O(kInlineCapacity).
+    void Promote() {
+        auto large = std::make_unique<map_type>(hasher_, key_equal_);
+        large->reserve(kInlineCapacity + 1);
+        Element *elements = InlineData();
+        for (size_t position = 0; position < inline_size_; ++position) {
+            auto &element = elements[position].mutable_value();
+            large->try_emplace(std::move(element.first), std::move(element.second));
+        }
+        DestroyInline();
+        large_ = std::move(large);
+    }
+
+    // Destroys the inline elements. O(n)
+    void DestroyInline() {
+        Element *elements = InlineData();
+        for (size_t position = 0; position < inline_size_; ++position) {
+            elements[position].~Element();
+        }
+        inline_size_ = 0;
+    }
+
+    // Helper function for the copy constructor and assignment, the map must be empty and inline.
+    // Time complexity: O(n).
+    void CopyFrom(const SmallHashMap &other) {
+        if (other.large_) {
+            large_ = std::make_unique<map_type>(*other.large_);
+            return;
+        }
+        const Element *elements = other.InlineData();
+        for (; inline_size_ < other.inline_size_; ++inline_size_) {
+            ::new (static_cast<void*>(InlineData() + inline_size_)) Element(elements[inline_size_]);
+        }
+    }
+
+    // Helper function for the move constructor and assignment, the map must be empty and inline.
+    // Leaves other empty.
+    // Time complexity: O(kInlineCapacity).
+    void MoveFrom(SmallHashMap &&other) {
+        large_ = std::move(other.large_);
+        Element *elements = other.InlineData();
+        for (; inline_size_ < other.inline_size_; ++inline_size_) {
+            ::new (static_cast<void*>(InlineData() + inline_size_)) Element(std::move(elements[inline_size_]));
+        }
+        other.DestroyInline();
+    }
+};
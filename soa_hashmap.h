@@ -0,0 +1,617 @@
+#pragma once
+
+#include<algorithm>
+#include<cstddef>
+#include<functional>
+#include<initializer_list>
+#include<iterator>
+#include<memory>
+#include<stdexcept>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+#include"hashmap.h"
+
+// Non-owning view of a contiguous array, standing in for std::span which is not available in C++17.
+template<class T>
+class Span {
+  public:
+    Span() = default;
+
+    Span(T *data, size_t size) : data_(data), size_(size) {}
+
+    // O(1)
+    T *data() const {
+        return data_;
+    }
+
+    // O(1)
+    size_t size() const {
+        return size_;
+    }
+
+    // O(1)
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    // O(1)
+    T *begin() const {
+        return data_;
+    }
+
+    // O(1)
+    T *end() const {
+        return data_ + size_;
+    }
+
+    // O(1)
+    T &operator[](size_t index) const {
+        return data_[index];
+    }
+
+  private:
+    T *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// RandomAccessIterator for SoaHashMap, a pair of pointers into the key and the value arrays.
+// Keys and values are not stored as pairs, so dereferencing yields a pair of references
+// and operator-> returns a proxy holding it; key() and value() access either array alone.
+template<class KeyType, class ValueType, bool kConst>
+class SoaIter {
+  public:
+    typedef typename std::conditional<kConst, const ValueType, ValueType>::type mapped_reference_type;
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef std::pair<KeyType, ValueType> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::pair<const KeyType&, mapped_reference_type&> reference;
+
+    // Holds the pair of references operator-> points to.
+    class pointer {
+      public:
+        explicit pointer(reference element) : element_(element) {}
+
+        // O(1)
+        reference *operator->() {
+            return &element_;
+        }
+
+      private:
+        reference element_;
+    };
+
+    SoaIter() = default;
+
+    SoaIter(const KeyType *key, mapped_reference_type *value) : key_(key), value_(value) {}
+
+    // Constant iterators are constructible from mutable ones.
+    template<bool kOtherConst, class = typename std::enable_if<kConst && !kOtherConst>::type>
+    SoaIter(SoaIter<KeyType, ValueType, kOtherConst> other) : key_(&other.key()), value_(&other.value()) {}
+
+    // O(1)
+    const KeyType &key() const {
+        return *key_;
+    }
+
+    // O(1)
+    mapped_reference_type &value() const {
+        return *value_;
+    }
+
+    // O(1)
+    reference operator*() const {
+        return reference(*key_, *value_);
+    }
+
+    // O(1)
+    pointer operator->() const {
+        return pointer(**this);
+    }
+
+    // O(1)
+    reference operator[](difference_type n) const {
+        return *(*this + n);
+    }
+
+    // O(1)
+    SoaIter &operator++() {
+        ++key_;
+        ++value_;
+        return *this;
+    }
+
+    // O(1)
+    SoaIter operator++(int) {
+        SoaIter copy = *this;
+        ++*this;
+        return copy;
+    }
+
+    // O(1)
+    SoaIter &operator--() {
+        --key_;
+        --value_;
+        return *this;
+    }
+
+    // O(1)
+    SoaIter operator--(int) {
+        SoaIter copy = *this;
+        --*this;
+        return copy;
+    }
+
+    // O(1)
+    SoaIter &operator+=(difference_type n) {
+        key_ += n;
+        value_ += n;
+        return *this;
+    }
+
+    // O(1)
+    SoaIter &operator-=(difference_type n) {
+        return *this += -n;
+    }
+
+    // O(1)
+    SoaIter operator+(difference_type n) const {
+        SoaIter copy = *this;
+        return copy += n;
+    }
+
+    // O(1)
+    friend SoaIter operator+(difference_type n, SoaIter iter) {
+        return iter + n;
+    }
+
+    // O(1)
+    SoaIter operator-(difference_type n) const {
+        SoaIter copy = *this;
+        return copy -= n;
+    }
+
+    // O(1)
+    difference_type operator-(SoaIter other) const {
+        return key_ - other.key_;
+    }
+
+    // O(1)
+    bool operator==(SoaIter other) const {
+        return key_ == other.key_;
+    }
+
+    // O(1)
+    bool operator!=(SoaIter other) const {
+        return key_ != other.key_;
+    }
+
+    // O(1)
+    bool operator<(SoaIter other) const {
+        return key_ < other.key_;
+    }
+
+    // O(1)
+    bool operator>(SoaIter other) const {
+        return key_ > other.key_;
+    }
+
+    // O(1)
+    bool operator<=(SoaIter other) const {
+        return key_ <= other.key_;
+    }
+
+    // O(1)
+    bool operator>=(SoaIter other) const {
+        return key_ >= other.key_;
+    }
+
+  private:
+    const KeyType *key_ = nullptr;
+    mapped_reference_type *value_ = nullptr;
+};
+
+// Structure-of-arrays variant of HashMap. https://en.wikipedia.org/wiki/AoS_and_SoA
+// Keeps the same dense-index design, with the same index and resize policies, but stores keys and values
+// in two separate contiguous arrays, which stay parallel: the element at position i is (keys()[i], values()[i]).
+// Probes compare keys without pulling value bytes into cache, and keys() / values() expose the arrays
+// as spans, so that scans and reductions over values alone can be vectorized by the compiler.
+// Erasing still moves the last element into the freed position, in both arrays.
+// As in HashMap, the index is allocated by the first insertion, and heterogeneous lookups and erasure
+// are available with transparent hash and key equality functors.
+// It is a class of its own rather than a storage policy of HashMap, since its iterators cannot yield the
+// std::pair<const KeyType, ValueType> references of HashMap; the upkeep of the index is shared, see RebuildIndex().
+template<class KeyType, class ValueType, class Hash = std::hash<KeyType>, class IndexPolicy = ChainedIndex,
+         class ResizePolicy = DefaultResizePolicy, class KeyEqual = std::equal_to<KeyType>,
+         class Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
+class SoaHashMap {
+    static_assert(!std::is_same<KeyType, bool>::value && !std::is_same<ValueType, bool>::value,
+                  "std::vector<bool> is not contiguous, use another type");
+
+    typedef std::vector<KeyType, RebindAllocator<Allocator, KeyType>> KeyStorage;
+    typedef std::vector<ValueType, RebindAllocator<Allocator, ValueType>> ValueStorage;
+    using Index = typename IndexPolicy::template Rebind<Allocator>;
+
+  public:
+    typedef SoaIter<KeyType, ValueType, false> iterator;
+    typedef SoaIter<KeyType, ValueType, true> const_iterator;
+    typedef std::pair<KeyType, ValueType> value_type;
+    typedef Allocator allocator_type;
+
+    SoaHashMap(const Hash &hasher = Hash(), const Allocator &allocator = Allocator())
+        : indices_(capacity_, allocator),
+          keys_(RebindAllocator<Allocator, KeyType>(allocator)),
+          values_(RebindAllocator<Allocator, ValueType>(allocator)),
+          hasher_(hasher) {}
+
+    // Constructor from two iterators.
+    // Random access ranges are inserted into a map which is pre-sized for all of their elements.
+    template<class Iterator>
+    SoaHashMap(Iterator first, Iterator last, const Hash &h = Hash(), const Allocator &allocator = Allocator())
+        : SoaHashMap(h, allocator) {
+        if constexpr (std::is_base_of<std::random_access_iterator_tag,
+                                      typename std::iterator_traits<Iterator>::iterator_category>::value) {
+            reserve(static_cast<size_t>(last - first));
+        }
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    // Constructor from initializer list.
+    SoaHashMap(std::initializer_list<std::pair<KeyType, ValueType>> init_list, const Hash &h = Hash(),
+               const Allocator &allocator = Allocator())
+        : SoaHashMap(init_list.begin(), init_list.end(), h, allocator) {}
+
+    // O(1)
+    iterator begin() {
+        return iterator(keys_.data(), values_.data());
+    }
+
+    // O(1)
+    iterator end() {
+        return begin() + static_cast<std::ptrdiff_t>(keys_.size());
+    }
+
+    // O(1)
+    const_iterator begin() const {
+        return const_iterator(keys_.data(), values_.data());
+    }
+
+    // O(1)
+    const_iterator end() const {
+        return begin() + static_cast<std::ptrdiff_t>(keys_.size());
+    }
+
+    // Returns all keys, in the same order as values() and the iterators. O(1)
+    Span<const KeyType> keys() const {
+        return Span<const KeyType>(keys_.data(), keys_.size());
+    }
+
+    // Returns all values, which may be modified in place. O(1)
+    Span<ValueType> values() {
+        return Span<ValueType>(values_.data(), values_.size());
+    }
+
+    // O(1)
+    Span<const ValueType> values() const {
+        return Span<const ValueType>(values_.data(), values_.size());
+    }
+
+    // O(1)
+    size_t size() const {
+        return keys_.size();
+    }
+
+    // O(1)
+    bool empty() const {
+        return keys_.empty();
+    }
+
+    // Finds the element with given key, returns end() if there is none.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    iterator find(const KeyType &key) {
+        return begin() + AsOffset(FindPosition(key));
+    }
+
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    const_iterator find(const KeyType &key) const {
+        return begin() + AsOffset(FindPosition(key));
+    }
+
+    // Heterogeneous lookup, only available with transparent hash and key equality functors.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    iterator find(const K &key) {
+        return begin() + AsOffset(FindPosition(key));
+    }
+
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    const_iterator find(const K &key) const {
+        return begin() + AsOffset(FindPosition(key));
+    }
+
+    // Returns the number of elements with given key, that is 1 or 0.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    size_t count(const KeyType &key) const {
+        return FindPosition(key) != Index::kNotFound;
+    }
+
+    // Heterogeneous version of the above, available if both Hash and KeyEqual are transparent.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    size_t count(const K &key) const {
+        return FindPosition(key) != Index::kNotFound;
+    }
+
+    // Returns the value of the element with given key, throws std::out_of_range if there is none.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    ValueType &at(const KeyType &key) {
+        return values_[AtPosition(key)];
+    }
+
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    const ValueType &at(const KeyType &key) const {
+        return values_[AtPosition(key)];
+    }
+
+    // Heterogeneous version of the above, available if both Hash and KeyEqual are transparent.
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    ValueType &at(const K &key) {
+        return values_[AtPosition(key)];
+    }
+
+    // Time complexity: amortized O(1), individual query expected O(1), provided the hash function is good enough.
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    const ValueType &at(const K &key) const {
+        return values_[AtPosition(key)];
+    }
+
+    // Returns the value of the element with given key, inserting a default constructed one if there is none.
+    // Time complexity: amortized O(1), individual query O(n).
+    ValueType &operator[](const KeyType &key) {
+        return try_emplace(key).first.value();
+    }
+
+    // Time complexity: amortized O(1), individual query O(n).
+    ValueType &operator[](KeyType &&key) {
+        return try_emplace(std::move(key)).first.value();
+    }
+
+    // Inserts an element in case there does not already exist one with the same key.
+    // Returns an iterator to the inserted element (or the existing one).
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator insert(const std::pair<KeyType, ValueType> &element) {
+        return try_emplace(element.first, element.second).first;
+    }
+
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator insert(std::pair<KeyType, ValueType> &&element) {
+        return try_emplace(std::move(element.first), std::move(element.second)).first;
+    }
+
+    // Constructs the value from args in case there does not already exist an element with the same key.
+    // Returns an iterator to the element and whether it was inserted.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType &key, Args&&... args) {
+        return EmplaceImpl(key, std::forward<Args>(args)...);
+    }
+
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType &&key, Args&&... args) {
+        return EmplaceImpl(std::move(key), std::forward<Args>(args)...);
+    }
+
+    // Inserts an element, or assigns the value of the existing element with the same key.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class V>
+    std::pair<iterator, bool> insert_or_assign(const KeyType &key, V &&value) {
+        auto result = EmplaceImpl(key, std::forward<V>(value));
+        if (!result.second) {
+            result.first.value() = std::forward<V>(value);
+        }
+        return result;
+    }
+
+    // Erases the element with given key, if there is one.
+    // Time complexity: amortized O(1), individual query O(n).
+    void erase(const KeyType &key) {
+        EraseImpl(key);
+    }
+
+    // Heterogeneous version of the above, available if both Hash and KeyEqual are transparent.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class K, class = EnableIfTransparent<Hash, KeyEqual, K>>
+    void erase(const K &key) {
+        EraseImpl(key);
+    }
+
+    // Erases the element pointed to by given iterator, which must be dereferenceable.
+    // Returns an iterator to the same position, which now holds the element previously stored last.
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator erase(iterator position) {
+        return EraseAt(static_cast<size_t>(position - begin()));
+    }
+
+    // Same as above for a constant iterator.
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator erase(const_iterator position) {
+        return EraseAt(static_cast<size_t>(position - const_iterator(begin())));
+    }
+
+    // Empties the hashmap.
+    // Time complexity: O(n), where n is the number of elements contained inside the hashmap.
+    void clear() {
+        capacity_ = 0;
+        keys_.clear();
+        values_.clear();
+        indices_.Reset(capacity_);
+    }
+
+    // Pre-sizes the hashmap so that n elements can be stored without rebuilding it.
+    // Never reduces capacity.
+    // Time complexity: O(n + capacity) if the hashmap has to be rebuilt, O(1) otherwise.
+    void reserve(size_t n) {
+        if (n == 0) {
+            return;
+        }
+        Resize(resize_policy_.ReserveCapacity(n, capacity_));
+        keys_.reserve(n);
+        values_.reserve(n);
+    }
+
+    // Returns the current capacity, the number of buckets the index is sized for, 0 before the first insertion. O(1)
+    size_t bucket_count() const {
+        return capacity_;
+    }
+
+    // Returns the average number of elements per bucket. O(1)
+    float load_factor() const {
+        return capacity_ == 0 ? 0.0f : static_cast<float>(keys_.size()) / static_cast<float>(capacity_);
+    }
+
+    // O(1)
+    Hash hash_function() const {
+        return hasher_;
+    }
+
+    // O(1)
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+    // O(1)
+    allocator_type get_allocator() const {
+        return allocator_type(keys_.get_allocator());
+    }
+
+  private:
+    // Capacity 0 means the index has not been allocated yet, see HashMap.
+    size_t capacity_ = 0;
+
+    Index indices_;
+    KeyStorage keys_;
+    ValueStorage values_;
+    Hash hasher_;
+    KeyEqual key_equal_;
+    ResizePolicy resize_policy_;
+
+    // Turns a position into an iterator offset, Index::kNotFound into the offset of end(). O(1)
+    std::ptrdiff_t AsOffset(size_t position) const {
+        return static_cast<std::ptrdiff_t>(position == Index::kNotFound ? keys_.size() : position);
+    }
+
+    // Returns a function computing the hash of the key stored at given position.
+    auto PositionHasher() const {
+        return [this](size_t position) {
+            return hasher_(keys_[position]);
+        };
+    }
+
+    // Erasing leaves no holes, see HashMap::HoleChecker().
+    static auto HoleChecker() {
+        return [](size_t) {
+            return false;
+        };
+    }
+
+    // Returns position of given key, Index::kNotFound if there is none. Only the key array is read.
+    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
+    template<class K>
+    size_t FindPosition(const K &key) const {
+        return FindPosition(key, hasher_(key));
+    }
+
+    // Same as above for a key whose hash is already known.
+    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
+    template<class K>
+    size_t FindPosition(const K &key, size_t hash) const {
+        if (capacity_ == 0) {
+            return Index::kNotFound;
+        }
+        return indices_.Find(hash, [this, &key](size_t position) {
+            return key_equal_(keys_[position], key);
+        });
+    }
+
+    // Helper function for at().
+    // Time complexity: amortized O(1), expected O(1), provided the hash function is good enough.
+    template<class K>
+    size_t AtPosition(const K &key) const {
+        size_t position = FindPosition(key);
+        if (position == Index::kNotFound) {
+            throw std::out_of_range("Key not found");
+        }
+        return position;
+    }
+
+    // Helper function for all insertions. Looks the key up and, if it is absent,
+    // appends the key and the value constructed from args to their arrays.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class K, class... Args>
+    std::pair<iterator, bool> EmplaceImpl(K &&key, Args&&... args) {
+        size_t hash = hasher_(key);
+        size_t position = FindPosition(key, hash);
+        if (position != Index::kNotFound) {
+            return {begin() + AsOffset(position), false};
+        }
+        CheckPositionLimit<Index>(keys_.size() + 1);
+        Resize(resize_policy_.GrowCapacity(keys_.size(), std::max<size_t>(capacity_, 1)));
+        position = keys_.size();
+        keys_.emplace_back(std::forward<K>(key));
+        try {
+            values_.emplace_back(std::forward<Args>(args)...);
+        } catch (...) {
+            keys_.pop_back();
+            throw;
+        }
+        indices_.Insert(hash, position);
+        AdvanceIndex(indices_, PositionHasher());
+        if (indices_.ShouldRehash()) {
+            ResetIndex(indices_, capacity_, keys_.size(), PositionHasher(), HoleChecker());
+        }
+        return {begin() + AsOffset(position), true};
+    }
+
+    // Helper function for erase(). Erases the element with given key, if there is one.
+    // Time complexity: amortized O(1), individual query O(n).
+    template<class K>
+    void EraseImpl(const K &key) {
+        size_t position = FindPosition(key);
+        if (position != Index::kNotFound) {
+            EraseAt(position);
+        }
+    }
+
+    // Helper function. Erases the element at given position, moving the last element into it.
+    // Returns an iterator to the same position.
+    // Time complexity: amortized O(1), individual query O(n).
+    iterator EraseAt(size_t position) {
+        size_t last_position = keys_.size() - 1;
+        indices_.Erase(hasher_(keys_[position]), position);
+        if (position != last_position) {
+            indices_.Replace(hasher_(keys_[last_position]), last_position, position);
+            keys_[position] = std::move(keys_[last_position]);
+            values_[position] = std::move(values_[last_position]);
+        }
+        keys_.pop_back();
+        values_.pop_back();
+        Resize(resize_policy_.ShrinkCapacity(keys_.size(), capacity_));
+        AdvanceIndex(indices_, PositionHasher());
+        return begin() + static_cast<std::ptrdiff_t>(position);
+    }
+
+    // Rebuilds the index with given capacity unless it is the current one.
+    // Time complexity: O(1) if capacity does not change, O(n + capacity) otherwise.
+    void Resize(size_t capacity) {
+        if (capacity != capacity_) {
+            capacity_ = capacity;
+            RebuildIndex(indices_, capacity_, keys_.size(), PositionHasher(), HoleChecker());
+        }
+    }
+};
@@ -0,0 +1,250 @@
+#pragma once
+
+#include<array>
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<stdexcept>
+#include<string_view>
+#include<type_traits>
+#include<utility>
+
+#include"hashmap.h"
+
+// constexpr hash for the keys of StaticHashMap: FNV-1a for strings, the value itself for integers and enums.
+// https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+// StaticHashMap mixes the result, so weak hashes are fine as long as distinct keys get distinct hashes.
+struct StaticHash {
+    // O(length)
+    constexpr uint64_t operator()(std::string_view key) const {
+        uint64_t hash = UINT64_C(0xcbf29ce484222325);
+        for (char c : key) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * UINT64_C(0x100000001b3);
+        }
+        return hash;
+    }
+
+    // O(1)
+    template<class K, class = std::enable_if_t<std::is_integral<K>::value || std::is_enum<K>::value>>
+    constexpr uint64_t operator()(K key) const {
+        if constexpr (std::is_enum<K>::value) {
+            return static_cast<uint64_t>(static_cast<std::underlying_type_t<K>>(key));
+        } else {
+            return static_cast<uint64_t>(key);
+        }
+    }
+};
+
+// Read-only hashmap over a fixed set of kSize keys, built with a perfect hash function, so a lookup computes
+// one slot and compares one key, without any probing. https://en.wikipedia.org/wiki/Perfect_hash_function
+// Construction is constexpr, so a constexpr StaticHashMap is built by the compiler and needs no startup code:
+//     constexpr auto methods = make_static_hashmap<std::string_view, int>({{"GET", 1}, {"PUT", 2}});
+//     static_assert(methods.at("PUT") == 2);
+// The hash function is found by hash and displace (CHD, http://cmph.sourceforge.net/papers/esa09.pdf):
+// keys are split into buckets by their hash, and for every bucket, largest first, a seed is searched
+// which sends all of its keys to free slots of a power of two sized table. Buckets of a single key
+// take a free slot directly. A lookup mixes the hash of the key with the seed of its bucket.
+// Elements are iterated in the order they were given. Duplicate keys, and distinct keys with equal hashes,
+// throw std::invalid_argument, which fails compilation of a constexpr map.
+// Hash must be constexpr to build the map at compile time; it returns a uint64_t or anything convertible to it.
+template<class KeyType, class ValueType, size_t kSize, class Hash = StaticHash, class KeyEqual = std::equal_to<KeyType>>
+class StaticHashMap {
+  public:
+    typedef std::pair<KeyType, ValueType> value_type;
+    typedef const value_type *const_iterator;
+    typedef const_iterator iterator;
+
+    static_assert(kSize < (static_cast<size_t>(1) << 31), "too many keys for a static hashmap");
+
+    // Builds the perfect hash function for given elements.
+    // Time complexity: expected O(kSize).
+    constexpr explicit StaticHashMap(const std::array<value_type, kSize> &elements, const Hash &hasher = Hash(),
+                                     const KeyEqual &key_equal = KeyEqual())
+        : elements_(elements), slots_(), seeds_(), hasher_(hasher), key_equal_(key_equal) {
+        Build();
+    }
+
+    // O(1)
+    constexpr const_iterator begin() const {
+        return elements_.data();
+    }
+
+    // O(1)
+    constexpr const_iterator end() const {
+        return elements_.data() + kSize;
+    }
+
+    // O(1)
+    constexpr size_t size() const {
+        return kSize;
+    }
+
+    // O(1)
+    constexpr bool empty() const {
+        return kSize == 0;
+    }
+
+    // Finds the element with given key, returns end() if there is none.
+    // Time complexity: O(1), a single hash and key comparison.
+    constexpr const_iterator find(const KeyType &key) const {
+        uint64_t hash = static_cast<uint64_t>(hasher_(key));
+        uint32_t element = slots_[Slot(hash, seeds_[Bucket(hash)])];
+        if (element == kEmpty || !key_equal_(elements_[element].first, key)) {
+            return end();
+        }
+        return begin() + element;
+    }
+
+    // Returns the number of elements with given key, that is 1 or 0. O(1)
+    constexpr size_t count(const KeyType &key) const {
+        return find(key) != end();
+    }
+
+    // O(1)
+    constexpr bool contains(const KeyType &key) const {
+        return find(key) != end();
+    }
+
+    // Returns the value of the element with given key, throws std::out_of_range if there is none. O(1)
+    constexpr const ValueType &at(const KeyType &key) const {
+        const_iterator it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("Key not found");
+        }
+        return it->second;
+    }
+
+  private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+    // Marks a seed which holds the slot of the single key of its bucket.
+    static constexpr uint32_t kDirect = UINT32_C(1) << 31;
+    static constexpr uint32_t kMaxSeed = UINT32_C(1) << 20;
+    static constexpr size_t kBucketCount = kSize / 2 > 0 ? kSize / 2 : 1;
+    static constexpr size_t kSlotCount = NextPowerOfTwo(kSize);
+
+    std::array<value_type, kSize> elements_;
+    // Element stored in every slot, kEmpty for free slots.
+    std::array<uint32_t, kSlotCount> slots_;
+    std::array<uint32_t, kBucketCount> seeds_;
+    Hash hasher_;
+    KeyEqual key_equal_;
+
+    // The finalizer of SplitMix64. https://prng.di.unimi.it/splitmix64.c
+    // O(1)
+    static constexpr uint64_t Mix(uint64_t hash) {
+        hash = (hash ^ (hash >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        hash = (hash ^ (hash >> 27)) * UINT64_C(0x94d049bb133111eb);
+        return hash ^ (hash >> 31);
+    }
+
+    // O(1)
+    static constexpr size_t Bucket(uint64_t hash) {
+        return static_cast<size_t>(Mix(hash) % kBucketCount);
+    }
+
+    // O(1)
+    static constexpr size_t Slot(uint64_t hash, uint32_t seed) {
+        if (seed & kDirect) {
+            return seed & ~kDirect;
+        }
+        return static_cast<size_t>(Mix(hash ^ (seed * UINT64_C(0x9e3779b97f4a7c15))) & (kSlotCount - 1));
+    }
+
+    // Splits the keys into buckets and places the buckets, largest first.
+    // Time complexity: expected O(kSize).
+    constexpr void Build() {
+        std::array<uint64_t, kSize> hashes{};
+        std::array<size_t, kBucketCount + 1> bucket_begin{};
+        for (size_t element = 0; element < kSize; ++element) {
+            hashes[element] = static_cast<uint64_t>(hasher_(elements_[element].first));
+            ++bucket_begin[Bucket(hashes[element]) + 1];
+        }
+        for (size_t bucket = 0; bucket < kBucketCount; ++bucket) {
+            bucket_begin[bucket + 1] += bucket_begin[bucket];
+        }
+        std::array<size_t, kBucketCount + 1> bucket_end = bucket_begin;
+        std::array<uint32_t, kSize> members{};
+        for (size_t element = 0; element < kSize; ++element) {
+            members[bucket_end[Bucket(hashes[element])]++] = static_cast<uint32_t>(element);
+        }
+        // Equal hashes fall into the same bucket, so only keys of one bucket are compared.
+        for (size_t member = 0; member < kSize; ++member) {
+            for (size_t other = bucket_begin[Bucket(hashes[members[member]])]; other < member; ++other) {
+                if (hashes[members[other]] == hashes[members[member]]) {
+                    throw std::invalid_argument(
+                        key_equal_(elements_[members[other]].first, elements_[members[member]].first)
+                        ? "StaticHashMap: duplicate key" : "StaticHashMap: equal hashes");
+                }
+            }
+        }
+        // Counting sort of the buckets by decreasing size.
+        std::array<size_t, kSize + 2> size_begin{};
+        for (size_t bucket = 0; bucket < kBucketCount; ++bucket) {
+            ++size_begin[kSize - (bucket_begin[bucket + 1] - bucket_begin[bucket]) + 1];
+        }
+        for (size_t size = 0; size <= kSize; ++size) {
+            size_begin[size + 1] += size_begin[size];
+        }
+        std::array<size_t, kBucketCount> order{};
+        for (size_t bucket = 0; bucket < kBucketCount; ++bucket) {
+            order[size_begin[kSize - (bucket_begin[bucket + 1] - bucket_begin[bucket])]++] = bucket;
+        }
+        for (uint32_t &slot : slots_) {
+            slot = kEmpty;
+        }
+        size_t free_slot = 0;
+        for (size_t bucket : order) {
+            size_t first = bucket_begin[bucket], last = bucket_begin[bucket + 1];
+            if (last - first == 1) {
+                while (slots_[free_slot] != kEmpty) {
+                    ++free_slot;
+                }
+                seeds_[bucket] = kDirect | static_cast<uint32_t>(free_slot);
+                slots_[free_slot] = members[first];
+            } else if (last - first > 1) {
+                seeds_[bucket] = FindSeed(hashes, members, first, last);
+                for (size_t member = first; member < last; ++member) {
+                    slots_[Slot(hashes[members[member]], seeds_[bucket])] = members[member];
+                }
+            }
+        }
+    }
+
+    // Returns the first seed sending the keys members[first, last) to distinct free slots.
+    // Time complexity: expected O((last - first)^2) per tried seed.
+    constexpr uint32_t FindSeed(const std::array<uint64_t, kSize> &hashes, const std::array<uint32_t, kSize> &members,
+                                size_t first, size_t last) const {
+        for (uint32_t seed = 0; seed < kMaxSeed; ++seed) {
+            bool fits = true;
+            for (size_t member = first; member < last && fits; ++member) {
+                size_t slot = Slot(hashes[members[member]], seed);
+                fits = slots_[slot] == kEmpty;
+                for (size_t other = first; other < member && fits; ++other) {
+                    fits = Slot(hashes[members[other]], seed) != slot;
+                }
+            }
+            if (fits) {
+                return seed;
+            }
+        }
+        throw std::invalid_argument("StaticHashMap: no perfect hash function found");
+    }
+};
+
+// Helper function for make_static_hashmap().
+// Time complexity: see StaticHashMap().
+template<class KeyType, class ValueType, class Hash, size_t kSize, size_t... kIndices>
+constexpr StaticHashMap<KeyType, ValueType, kSize, Hash> ToStaticHashMap(
+        const std::pair<KeyType, ValueType> (&elements)[kSize], const Hash &hasher, std::index_sequence<kIndices...>) {
+    return StaticHashMap<KeyType, ValueType, kSize, Hash>(
+        std::array<std::pair<KeyType, ValueType>, kSize>{{elements[kIndices]...}}, hasher);
+}
+
+// Builds a StaticHashMap from a braced list of elements, deducing its size:
+//     constexpr auto map = make_static_hashmap<std::string_view, int>({{"a", 1}, {"b", 2}});
+// Time complexity: see StaticHashMap().
+template<class KeyType, class ValueType, class Hash = StaticHash, size_t kSize>
+constexpr StaticHashMap<KeyType, ValueType, kSize, Hash> make_static_hashmap(
+        const std::pair<KeyType, ValueType> (&elements)[kSize], const Hash &hasher = Hash()) {
+    return ToStaticHashMap(elements, hasher, std::make_index_sequence<kSize>());
+}
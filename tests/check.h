@@ -0,0 +1,13 @@
+#pragma once
+
+#include<cstdio>
+#include<cstdlib>
+
+// Like assert, but also checked in release builds: prints the failed condition and exits with a non-zero status.
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            std::exit(EXIT_FAILURE);                                                         \
+        }                                                                                    \
+    } while (false)
@@ -0,0 +1,83 @@
+// GroupProbingIndex counts the tombstones erasing leaves and asks to be rebuilt before they fill the index.
+
+#include"check.h"
+#include"hashmap.h"
+
+#include<cstdint>
+
+namespace {
+
+struct IdentityHash {
+    size_t operator()(uint64_t key) const {
+        return static_cast<size_t>(key);
+    }
+};
+
+// Erasing from full groups leaves tombstones; once they leave too few empty slots the index asks to be rebuilt,
+// which a reset at the same size satisfies.
+void TestTombstones() {
+    typedef BasicGroupProbingIndex<MaskBucketMapping> Index;
+    const size_t capacity = 64;
+    Index index(capacity);
+    const size_t slots = index.SlotCount();
+    // Hashes below 128 share home group 0, so the positions fill the groups one after another.
+    const size_t count = slots - slots / 16;
+    for (size_t position = 0; position < count; ++position) {
+        index.Insert(position % 128, position);
+    }
+    CHECK(!index.ShouldRehash());
+    size_t erased = 0;
+    for (size_t position = 0; position < count && !index.ShouldRehash(); ++position, ++erased) {
+        CHECK(index.Erase(position % 128, position));
+    }
+    CHECK(index.ShouldRehash());
+    CHECK(erased > slots / 16);
+    for (size_t position = erased; position < count; ++position) {
+        CHECK(index.Find(position % 128, [position](size_t candidate) {
+            return candidate == position;
+        }) == position);
+    }
+    index.Reset(capacity);
+    for (size_t position = erased; position < count; ++position) {
+        index.Insert(position % 128, position);
+    }
+    CHECK(!index.ShouldRehash());
+}
+
+// A sliding window of keys keeps the size of the map constant, so it never resizes, while every erasure
+// may leave a tombstone behind. The map has to rebuild its index now and then to drop them.
+template<class IndexPolicy>
+void TestSlidingWindow() {
+    HashMap<uint64_t, uint64_t, IdentityHash, IndexPolicy, DefaultResizePolicy, std::equal_to<uint64_t>, false,
+            std::allocator<std::pair<const uint64_t, uint64_t>>, CollectStats> map;
+    const uint64_t window = 4096;
+    // The window is one key wider while a key is inserted before the oldest one goes, which grows the map once.
+    for (uint64_t key = 0; key <= window; ++key) {
+        map.emplace(key, key);
+    }
+    map.erase(0);
+    size_t rebuilds = map.stats().rebuild_count;
+    size_t bucket_count = map.stats().bucket_count;
+    for (uint64_t key = window + 1; key < 100 * window; ++key) {
+        map.emplace(key, key);
+        map.erase(key - window);
+        if (key % 1009 == 0) {
+            CHECK(map.count(key + window) == 0);
+            CHECK(map.at(key - window / 2) == key - window / 2);
+        }
+    }
+    CHECK(map.size() == window);
+    CHECK(map.stats().bucket_count == bucket_count);
+    CHECK(map.stats().rebuild_count > rebuilds);
+    for (uint64_t key = 99 * window; key < 100 * window; ++key) {
+        CHECK(map.at(key) == key);
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestTombstones();
+    TestSlidingWindow<GroupProbingIndex>();
+    TestSlidingWindow<IncrementalIndex<GroupProbingIndex>>();
+}
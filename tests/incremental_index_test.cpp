@@ -0,0 +1,114 @@
+// IncrementalIndex keeps every position reachable while a migration is spread over later operations.
+
+#include"check.h"
+#include"hashmap.h"
+
+#include<cstdint>
+#include<random>
+#include<unordered_map>
+#include<vector>
+
+namespace {
+
+size_t HashOfPosition(size_t position) {
+    return static_cast<size_t>(position * UINT64_C(0x9e3779b97f4a7c15));
+}
+
+// Drives the index directly: a migration is started, and positions are looked up, erased and inserted
+// between the steps of the migration, which must not lose any of them.
+template<class Index>
+void TestMigration() {
+    const size_t count = 1000;
+    Index index(count);
+    for (size_t position = 0; position < count; ++position) {
+        index.Insert(HashOfPosition(position), position);
+    }
+    std::vector<bool> present(count, true);
+    auto find = [&index](size_t position) {
+        return index.Find(HashOfPosition(position), [position](size_t candidate) {
+            return candidate == position;
+        });
+    };
+    index.StartResize(4 * count, HashOfPosition);
+    CHECK(index.Migrating());
+    size_t steps = 0;
+    for (size_t position = 0; index.Migrating(); position = (position + 7) % count, ++steps) {
+        if (position % 3 == 0) {
+            CHECK(index.Erase(HashOfPosition(position), position) == present[position]);
+            present[position] = false;
+        } else if (position % 3 == 1 && !present[position]) {
+            index.Insert(HashOfPosition(position), position);
+            present[position] = true;
+        }
+        for (size_t probe = position; probe < count; probe += 97) {
+            CHECK((find(probe) == probe) == present[probe]);
+        }
+        index.Advance(HashOfPosition);
+    }
+    // With one slot per step the migration has to take many steps.
+    CHECK(steps > 100);
+    for (size_t position = 0; position < count; ++position) {
+        CHECK((find(position) == position) == present[position]);
+        CHECK(!present[position] || index.Erase(HashOfPosition(position), position));
+        CHECK(find(position) == Index::kNotFound);
+    }
+}
+
+// Checks the map against std::unordered_map over a random mix of insertions, lookups and erasures,
+// so that resizes happen and their migrations overlap with all of these operations.
+template<class Map>
+void TestAgainstModel() {
+    Map map;
+    std::unordered_map<uint32_t, uint32_t> model;
+    std::mt19937 random(12345);
+    for (size_t operation = 0; operation < 200000; ++operation) {
+        // The key range changes over time, so the map grows and shrinks several times.
+        uint32_t range = operation % 50000 < 25000 ? 20000 : 500;
+        uint32_t key = random() % range;
+        switch (random() % 4) {
+            case 0:
+            case 1:
+                CHECK(map.try_emplace(key, key * 3).second == model.try_emplace(key, key * 3).second);
+                break;
+            case 2:
+                map.erase(key);
+                model.erase(key);
+                break;
+            default: {
+                auto it = map.find(key);
+                auto expected = model.find(key);
+                CHECK((it == map.end()) == (expected == model.end()));
+                CHECK(it == map.end() || it->second == expected->second);
+            }
+        }
+        CHECK(map.size() == model.size());
+    }
+    for (const auto &element : model) {
+        CHECK(map.at(element.first) == element.second);
+    }
+    size_t visited = 0;
+    for (auto it = map.begin(); it != map.end(); ++it, ++visited) {
+        CHECK(model.at((*it).first) == it->second);
+    }
+    CHECK(visited == model.size());
+}
+
+template<class IndexPolicy, class ErasePolicy = SwapErase>
+using TestMap = HashMap<uint32_t, uint32_t, std::hash<uint32_t>, IndexPolicy, DefaultResizePolicy,
+                        std::equal_to<uint32_t>, false, std::allocator<std::pair<const uint32_t, uint32_t>>,
+                        NoStats, ErasePolicy>;
+
+}  // namespace
+
+int main() {
+    TestMigration<IncrementalIndex<ChainedIndex, 1>>();
+    TestMigration<IncrementalIndex<RobinHoodIndex, 1>>();
+    TestMigration<IncrementalIndex<GroupProbingIndex, 1>>();
+    TestMigration<IncrementalIndex<CompactRobinHoodIndex, 1>>();
+
+    TestAgainstModel<TestMap<IncrementalIndex<ChainedIndex, 1>>>();
+    TestAgainstModel<TestMap<IncrementalIndex<RobinHoodIndex, 1>>>();
+    TestAgainstModel<TestMap<IncrementalIndex<GroupProbingIndex, 1>>>();
+    TestAgainstModel<TestMap<IncrementalIndex<ChainedIndex>, DeferredErase>>();
+    TestAgainstModel<TestMap<IncrementalIndex<RobinHoodIndex>, OrderedErase>>();
+}
@@ -0,0 +1,161 @@
+// HashMap iterators hand out references to std::pair<const KeyType, ValueType>, while the map still moves keys
+// instead of copying them when its storage is reallocated, compacted or erased from.
+
+#include"check.h"
+#include"hashmap.h"
+
+#include<algorithm>
+#include<functional>
+#include<iterator>
+#include<memory>
+#include<string>
+#include<type_traits>
+#include<utility>
+#include<vector>
+
+namespace {
+
+// Key counting its copies, so that a map copying keys behind the scenes is noticed.
+struct Key {
+    static int copies;
+
+    std::string name;
+
+    explicit Key(std::string name) : name(std::move(name)) {}
+
+    Key(const Key &other) : name(other.name) {
+        ++copies;
+    }
+
+    Key(Key &&other) noexcept = default;
+
+    Key &operator=(const Key &other) {
+        name = other.name;
+        ++copies;
+        return *this;
+    }
+
+    Key &operator=(Key &&other) noexcept = default;
+
+    friend bool operator==(const Key &lhs, const Key &rhs) {
+        return lhs.name == rhs.name;
+    }
+};
+
+int Key::copies = 0;
+
+struct KeyHash {
+    size_t operator()(const Key &key) const {
+        return std::hash<std::string>()(key.name);
+    }
+};
+
+template<class Map, class KeyType, class ValueType>
+void CheckIteratorTypes() {
+    typedef typename Map::iterator iterator;
+    typedef typename Map::const_iterator const_iterator;
+    typedef typename Map::value_type value_type;
+    static_assert(std::is_same<value_type, std::pair<const KeyType, ValueType>>::value,
+                  "value_type is that of std::unordered_map");
+    static_assert(std::is_same<typename std::iterator_traits<iterator>::reference, value_type&>::value,
+                  "iterators yield real references");
+    static_assert(std::is_same<typename std::iterator_traits<const_iterator>::reference, const value_type&>::value,
+                  "const iterators yield real references");
+    static_assert(std::is_same<decltype(&*std::declval<iterator>()),
+                               typename std::iterator_traits<iterator>::pointer>::value, "operator-> agrees with operator*");
+}
+
+template<class ErasePolicy>
+using StringMap = HashMap<std::string, int, std::hash<std::string>, ChainedIndex, DefaultResizePolicy,
+                          std::equal_to<std::string>, false, std::allocator<std::pair<const std::string, int>>,
+                          NoStats, ErasePolicy>;
+
+template<class ErasePolicy>
+using KeyMap = HashMap<Key, std::unique_ptr<int>, KeyHash, RobinHoodIndex, DefaultResizePolicy, std::equal_to<Key>,
+                       true, std::allocator<std::pair<const Key, std::unique_ptr<int>>>, NoStats, ErasePolicy>;
+
+template<class ErasePolicy>
+void TestReferences() {
+    CheckIteratorTypes<StringMap<ErasePolicy>, std::string, int>();
+    StringMap<ErasePolicy> map;
+    for (int i = 0; i < 1000; ++i) {
+        map.emplace(std::to_string(i), i);
+    }
+    for (auto &element : map) {
+        element.second *= 2;
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        map.erase(std::to_string(i));
+    }
+    const auto &const_map = map;
+    size_t visited = 0;
+    for (const auto &element : const_map) {
+        CHECK(element.second == 2 * std::stoi(element.first));
+        ++visited;
+    }
+    CHECK(visited == 500);
+    // Iterators of both kinds point into the map itself.
+    auto it = map.find("7");
+    CHECK(&it->second == &map.at("7"));
+    CHECK(&const_map.find("7")->second == &map.at("7"));
+    static_assert(!std::is_assignable<decltype((it->first)), std::string>::value, "keys are read-only");
+}
+
+// Random access iterators support the whole arithmetic of their category.
+void TestRandomAccess() {
+    StringMap<SwapErase> map;
+    for (int i = 0; i < 100; ++i) {
+        map.emplace(std::to_string(i), i);
+    }
+    static_assert(std::is_same<std::iterator_traits<StringMap<SwapErase>::iterator>::iterator_category,
+                               std::random_access_iterator_tag>::value, "dense storage is random access");
+    auto first = map.begin();
+    CHECK(std::distance(first, map.end()) == 100);
+    CHECK(&first[42] == &*(first + 42));
+    CHECK((first + 42) - first == 42);
+    std::vector<int> values;
+    std::transform(map.begin(), map.end(), std::back_inserter(values), [](const auto &element) {
+        return element.second;
+    });
+    std::sort(values.begin(), values.end());
+    for (int i = 0; i < 100; ++i) {
+        CHECK(values[i] == i);
+    }
+}
+
+// Keys are stored as const for their users, yet moved when storage grows, elements are erased or compacted,
+// and when they are extracted or merged.
+template<class ErasePolicy>
+void TestKeysAreMoved() {
+    Key::copies = 0;
+    KeyMap<ErasePolicy> map;
+    for (int i = 0; i < 5000; ++i) {
+        map.try_emplace(Key(std::to_string(i)), std::make_unique<int>(i));
+    }
+    for (int i = 0; i < 5000; i += 3) {
+        map.erase(Key(std::to_string(i)));
+    }
+    map.compact();
+    auto node = map.extract(Key("1"));
+    CHECK(node.key().name == "1" && *node.mapped() == 1);
+    KeyMap<ErasePolicy> other;
+    other.insert(std::move(node));
+    other.merge(map);
+    CHECK(Key::copies == 0);
+    CHECK(other.size() == 5000 - 1667);
+    for (const auto &element : other) {
+        CHECK(*element.second == std::stoi(element.first.name));
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestReferences<SwapErase>();
+    TestReferences<DeferredErase>();
+    TestReferences<OrderedErase>();
+    TestRandomAccess();
+    TestKeysAreMoved<SwapErase>();
+    TestKeysAreMoved<DeferredErase>();
+    TestKeysAreMoved<OrderedErase>();
+}
@@ -0,0 +1,49 @@
+// Maps refuse to hold more elements than the position type of their index can record.
+
+#include"check.h"
+#include"hashmap.h"
+#include"soa_hashmap.h"
+
+#include<cstdint>
+#include<stdexcept>
+
+namespace {
+
+typedef BasicRobinHoodIndex<FibonacciBucketMapping, std::allocator<size_t>, uint16_t> TinyIndex;
+
+// Fills the map up to the limit of its index, then checks that one more element is refused
+// and that the refusal leaves the map intact.
+template<class Map>
+void TestLimit() {
+    const size_t limit = TinyIndex::kMaxPositions;
+    CHECK(limit == 65534);
+    Map map;
+    for (uint32_t key = 0; key < limit; ++key) {
+        map.try_emplace(key, key + 1);
+    }
+    CHECK(map.size() == limit);
+    bool thrown = false;
+    try {
+        map.try_emplace(uint32_t(limit), 0);
+    } catch (const std::length_error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(map.size() == limit);
+    CHECK(map.count(uint32_t(limit)) == 0);
+    // Present keys are still found, and do not count as insertions.
+    CHECK(!map.try_emplace(uint32_t(limit - 1), 0).second);
+    for (uint32_t key = 0; key < limit; ++key) {
+        CHECK(map.at(key) == key + 1);
+    }
+    // Room made by erasing can be used again.
+    map.erase(0);
+    CHECK(map.try_emplace(uint32_t(limit), 0).second);
+}
+
+}  // namespace
+
+int main() {
+    TestLimit<HashMap<uint32_t, uint32_t, std::hash<uint32_t>, TinyIndex>>();
+    TestLimit<SoaHashMap<uint32_t, uint32_t, std::hash<uint32_t>, TinyIndex>>();
+}
@@ -0,0 +1,123 @@
+// ReadMostlyHashMap frees a replaced version only after every reader that could still see it has finished.
+
+#include"check.h"
+#include"concurrent_hashmap.h"
+
+#include<atomic>
+#include<chrono>
+#include<cstdint>
+#include<optional>
+#include<string>
+#include<thread>
+#include<vector>
+
+namespace {
+
+// Counts its live instances, and is overwritten by its destructor so that a reader of a freed version notices.
+struct Tracked {
+    static constexpr uint64_t kAlive = UINT64_C(0x5a5a5a5a5a5a5a5a);
+    static std::atomic<long> live;
+
+    uint64_t magic = kAlive;
+    uint64_t value = 0;
+
+    explicit Tracked(uint64_t value = 0) : value(value) {
+        ++live;
+    }
+
+    Tracked(const Tracked &other) : value(other.value) {
+        ++live;
+    }
+
+    Tracked &operator=(const Tracked &other) {
+        value = other.value;
+        return *this;
+    }
+
+    ~Tracked() {
+        magic = 0;
+        --live;
+    }
+};
+
+std::atomic<long> Tracked::live{0};
+
+// A reader pins the version it sees. The writer replacing it publishes the new version at once,
+// but must not return, which would free the old version, before the reader has finished.
+void TestPinnedReader() {
+    ReadMostlyHashMap<int, std::string> map;
+    map.insert({1, "one"});
+    std::atomic<bool> reading{false}, release{false}, written{false};
+    std::thread reader([&] {
+        map.read([&](const auto &snapshot) {
+            reading = true;
+            while (!release) {
+                std::this_thread::yield();
+            }
+            CHECK(snapshot.size() == 1 && snapshot.at(1) == "one");
+        });
+    });
+    while (!reading) {
+        std::this_thread::yield();
+    }
+    std::thread writer([&] {
+        map.insert_or_assign(1, "uno");
+        written = true;
+    });
+    // New readers see the new version while the old one is still pinned.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (map.find(1) != std::optional<std::string>("uno")) {
+        CHECK(std::chrono::steady_clock::now() < deadline);
+        std::this_thread::yield();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!written);
+    release = true;
+    reader.join();
+    writer.join();
+    CHECK(written);
+    CHECK(map.find(1) == std::optional<std::string>("uno"));
+}
+
+// Readers keep looking at values while writers replace versions; no reader may see a freed value,
+// and once the map is gone no version may be left behind.
+void TestReclamation() {
+    {
+        ReadMostlyHashMap<int, Tracked> map;
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> readers;
+        for (int thread = 0; thread < 4; ++thread) {
+            readers.emplace_back([&map, &stop] {
+                while (!stop) {
+                    for (int key = 0; key < 16; ++key) {
+                        map.visit(key, [key](const Tracked &tracked) {
+                            CHECK(tracked.magic == Tracked::kAlive);
+                            CHECK(tracked.value % 16 == static_cast<uint64_t>(key));
+                        });
+                    }
+                    std::this_thread::yield();
+                }
+            });
+        }
+        for (uint64_t update = 0; update < 2000; ++update) {
+            int key = static_cast<int>(update % 16);
+            if (update % 5 == 4) {
+                map.erase(key);
+            } else {
+                map.insert_or_assign(key, Tracked(update));
+            }
+        }
+        stop = true;
+        for (std::thread &reader : readers) {
+            reader.join();
+        }
+    }
+    CHECK(Tracked::live == 0);
+}
+
+}  // namespace
+
+int main() {
+    TestPinnedReader();
+    TestReclamation();
+}
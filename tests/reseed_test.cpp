@@ -0,0 +1,144 @@
+// A flood of colliding keys reseeds SeededHash, also in the middle of a batched insertion.
+
+#include"check.h"
+#include"hashmap.h"
+
+#include<cstdint>
+#include<string>
+#include<unordered_map>
+#include<utility>
+#include<vector>
+
+namespace {
+
+const uint64_t kSeed = 42;
+const size_t kCollidingKeys = 256;
+// The attacked map masks hashes to its bucket count, which stays below this
+// while it holds the keys below, so keys agreeing in these bits share a chain.
+const size_t kBucketMask = (1 << 16) - 1;
+
+// Returns keys whose hashes under kSeed agree in the bits the index uses, as an attacker knowing the seed would.
+std::vector<uint64_t> CollidingKeys() {
+    SeededHash hasher(kSeed);
+    size_t target = hasher(uint64_t{0}) & kBucketMask;
+    std::vector<uint64_t> keys;
+    for (uint64_t key = 0; keys.size() < kCollidingKeys; ++key) {
+        if ((hasher(key) & kBucketMask) == target) {
+            keys.push_back(key);
+        }
+    }
+    return keys;
+}
+
+template<class ErasePolicy>
+using AttackedMap = HashMap<uint64_t, uint64_t, SeededHash, BasicChainedIndex<MaskBucketMapping>,
+                            DefaultResizePolicy, std::equal_to<uint64_t>, false,
+                            std::allocator<std::pair<const uint64_t, uint64_t>>, NoStats, ErasePolicy>;
+
+// One batch holds the whole flood and, after it, keys which have been hashed ahead under the old seed:
+// new ones, and repeated ones which must be found rather than inserted again.
+template<class ErasePolicy>
+void TestReseedMidBatch() {
+    std::vector<uint64_t> colliding = CollidingKeys();
+    std::vector<std::pair<uint64_t, uint64_t>> batch;
+    std::unordered_map<uint64_t, uint64_t> model;
+    auto add = [&batch, &model](uint64_t key) {
+        uint64_t value = batch.size();
+        batch.emplace_back(key, value);
+        model.emplace(key, value);
+    };
+    for (uint64_t key = 0; key < 8; ++key) {
+        add(key * 1000003 + 1);
+    }
+    for (uint64_t key : colliding) {
+        add(key);
+    }
+    for (size_t i = 0; i < colliding.size(); i += 3) {
+        add(colliding[i]);
+        add(colliding[i] + (uint64_t{1} << 40));
+    }
+    AttackedMap<ErasePolicy> map{SeededHash(kSeed)};
+    map.insert_many(batch.begin(), batch.end());
+    CHECK(map.stats().reseed_count != 0);
+    CHECK(map.stats().max_probe_length < 16);
+    CHECK(map.size() == model.size());
+    for (const auto &element : model) {
+        CHECK(map.count(element.first) == 1);
+        CHECK(map.at(element.first) == element.second);
+    }
+
+    // Erasing a batch hashes ahead as well.
+    std::vector<uint64_t> erased(colliding.begin(), colliding.begin() + colliding.size() / 2);
+    map.erase_many(erased.begin(), erased.end());
+    for (uint64_t key : erased) {
+        model.erase(key);
+    }
+    CHECK(map.size() == model.size());
+    for (const auto &element : model) {
+        CHECK(map.at(element.first) == element.second);
+    }
+}
+
+// Keys the map must not hash, such as those of the holes of lazy erasure while it reseeds.
+const std::unordered_map<std::string, int> *forbidden_keys = nullptr;
+
+struct GuardedHash : SeededHash {
+    using SeededHash::SeededHash;
+
+    size_t operator()(const std::string &key) const {
+        CHECK(forbidden_keys == nullptr || forbidden_keys->count(key) == 0);
+        return SeededHash::operator()(key);
+    }
+};
+
+// Reseeding hashes the stored keys again, but not those left in holes by lazy erasure.
+// Some of them are moved out by extract(), and all of them are skipped by the rebuilt index anyway.
+template<class ErasePolicy>
+void TestReseedSkipsHoles() {
+    HashMap<std::string, int, GuardedHash, BasicChainedIndex<MaskBucketMapping>, DefaultResizePolicy,
+            std::equal_to<std::string>, true, std::allocator<std::pair<const std::string, int>>, NoStats,
+            ErasePolicy> map{GuardedHash(kSeed)};
+    std::unordered_map<std::string, int> erased;
+    for (int i = 0; i < 100; ++i) {
+        map.emplace(std::to_string(i), i);
+    }
+    for (int i = 0; i < 100; i += 4) {
+        std::string key = std::to_string(i);
+        if (i % 8 == 0) {
+            map.erase(key);
+        } else {
+            CHECK(map.extract(key).key() == key);
+        }
+        erased.emplace(key, i);
+    }
+    // A flood of colliding keys makes the map reseed while the holes are still there.
+    GuardedHash hasher(kSeed);
+    size_t target = hasher(std::string("x")) & kBucketMask;
+    std::vector<std::string> colliding;
+    for (int i = 0; colliding.size() < 100; ++i) {
+        std::string key = "x" + std::to_string(i);
+        if ((hasher(key) & kBucketMask) == target) {
+            colliding.push_back(key);
+        }
+    }
+    forbidden_keys = &erased;
+    for (const std::string &key : colliding) {
+        map.emplace(key, -1);
+    }
+    forbidden_keys = nullptr;
+    CHECK(map.stats().reseed_count != 0);
+    CHECK(map.size() == 175);
+    for (int i = 0; i < 100; ++i) {
+        CHECK(map.count(std::to_string(i)) == (i % 4 == 0 ? 0u : 1u));
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestReseedMidBatch<SwapErase>();
+    TestReseedMidBatch<DeferredErase>();
+    TestReseedMidBatch<OrderedErase>();
+    TestReseedSkipsHoles<DeferredErase>();
+    TestReseedSkipsHoles<OrderedErase>();
+}
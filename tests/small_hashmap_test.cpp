@@ -0,0 +1,145 @@
+// SmallHashMap behaves as a map with read-only keys both inline and after promotion to a HashMap.
+
+#include"check.h"
+#include"small_hashmap.h"
+
+#include<cctype>
+#include<iterator>
+#include<random>
+#include<string>
+#include<type_traits>
+#include<unordered_map>
+#include<utility>
+
+namespace {
+
+typedef SmallHashMap<int, int, 4> Map;
+
+static_assert(std::is_same<Map::value_type, std::pair<const int, int>>::value, "value_type is that of std::unordered_map");
+static_assert(std::is_same<std::iterator_traits<Map::iterator>::reference, Map::value_type&>::value,
+              "iterators yield references to the stored pairs");
+static_assert(std::is_same<std::iterator_traits<Map::const_iterator>::reference, const Map::value_type&>::value,
+              "const iterators yield references to the stored pairs");
+static_assert(!std::is_assignable<decltype((std::declval<Map::iterator>()->first)), int>::value, "keys are read-only");
+static_assert(std::is_convertible<Map::iterator, Map::const_iterator>::value, "iterators convert to const iterators");
+
+void CheckEqual(const Map &map, const std::unordered_map<int, int> &model) {
+    CHECK(map.size() == model.size());
+    size_t visited = 0;
+    for (const auto &element : map) {
+        CHECK(model.at(element.first) == element.second);
+        ++visited;
+    }
+    CHECK(visited == model.size());
+    for (const auto &element : model) {
+        CHECK(map.find(element.first)->second == element.second);
+    }
+}
+
+// Random operations around the inline capacity, compared with std::unordered_map,
+// so that the map is promoted with elements erased through iterators before and after.
+void TestAgainstModel() {
+    std::mt19937 random(7);
+    Map map;
+    std::unordered_map<int, int> model;
+    for (int step = 0; step < 20000; ++step) {
+        int key = static_cast<int>(random() % 12);
+        switch (random() % 4) {
+            case 0: {
+                auto result = map.try_emplace(key, step);
+                CHECK(result.second == model.emplace(key, step).second);
+                CHECK(result.first->first == key && result.first->second == model.at(key));
+                break;
+            }
+            case 1: {
+                auto it = map.find(key);
+                if (it != map.end()) {
+                    auto next = map.erase(it);
+                    CHECK(next == map.begin() + (it - map.begin()));
+                    model.erase(key);
+                }
+                break;
+            }
+            case 2:
+                map.erase(key);
+                model.erase(key);
+                break;
+            case 3:
+                map.insert_or_assign(key, -step);
+                model[key] = -step;
+                break;
+        }
+        if (step % 97 == 0) {
+            CheckEqual(map, model);
+        }
+        if (step % 5000 == 4999) {
+            Map copy(map);
+            CheckEqual(copy, model);
+            Map moved(std::move(copy));
+            CheckEqual(moved, model);
+            map.clear();
+            model.clear();
+            CHECK(map.is_inline());
+        }
+    }
+}
+
+// Values are changed in place through iterators in both layouts.
+void TestMutation() {
+    Map map;
+    for (int key = 0; key < 10; ++key) {
+        map.try_emplace(key, key);
+        for (auto &element : map) {
+            ++element.second;
+        }
+        CHECK(map.is_inline() == (key < 4));
+    }
+    for (int key = 0; key < 10; ++key) {
+        CHECK(map.at(key) == 10);
+    }
+}
+
+struct CaseInsensitiveHash {
+    size_t operator()(const std::string &key) const {
+        std::string lower;
+        for (char c : key) {
+            lower += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return std::hash<std::string>()(lower);
+    }
+};
+
+struct CaseInsensitiveEqual {
+    bool operator()(const std::string &lhs, const std::string &rhs) const {
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            if (std::tolower(static_cast<unsigned char>(lhs[i])) != std::tolower(static_cast<unsigned char>(rhs[i]))) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Promotion moves the keys into the HashMap, which compares them with the same KeyEqual.
+void TestPromotedKeys() {
+    SmallHashMap<std::string, int, 2, CaseInsensitiveHash, ChainedIndex, CaseInsensitiveEqual> map;
+    map.try_emplace("Alpha", 1);
+    map.try_emplace("Beta", 2);
+    CHECK(!map.try_emplace("ALPHA", 0).second);
+    map.try_emplace("Gamma", 3);
+    CHECK(!map.is_inline());
+    CHECK(map.size() == 3);
+    CHECK(map.at("alpha") == 1 && map.at("BETA") == 2 && map.at("gamma") == 3);
+    CHECK(map.find("Beta")->first == "Beta");
+}
+
+}  // namespace
+
+int main() {
+    TestAgainstModel();
+    TestMutation();
+    TestPromotedKeys();
+}
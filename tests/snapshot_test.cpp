@@ -0,0 +1,95 @@
+// Snapshots round-trip through save() and load(), and a forged header cannot make load() allocate for data it lacks.
+
+#include"check.h"
+#include"hashmap.h"
+
+#include<algorithm>
+#include<cstdint>
+#include<memory>
+#include<sstream>
+#include<stdexcept>
+#include<string>
+#include<utility>
+
+namespace {
+
+// Largest allocation made through any CountingAllocator.
+size_t largest_allocation = 0;
+
+template<class T>
+struct CountingAllocator {
+    typedef T value_type;
+
+    CountingAllocator() = default;
+
+    template<class U>
+    CountingAllocator(const CountingAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        largest_allocation = std::max(largest_allocation, n * sizeof(T));
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T *pointer, size_t n) {
+        std::allocator<T>().deallocate(pointer, n);
+    }
+
+    friend bool operator==(const CountingAllocator &, const CountingAllocator &) {
+        return true;
+    }
+
+    friend bool operator!=(const CountingAllocator &, const CountingAllocator &) {
+        return false;
+    }
+};
+
+typedef HashMap<uint64_t, uint64_t, std::hash<uint64_t>, ChainedIndex, DefaultResizePolicy, std::equal_to<uint64_t>,
+                false, CountingAllocator<std::pair<const uint64_t, uint64_t>>> Map;
+
+void TestRoundTrip() {
+    Map map;
+    for (uint64_t key = 0; key < 100000; ++key) {
+        map.emplace(key * 7, key);
+    }
+    std::stringstream stream;
+    map.save(stream);
+    stream << "trailer";
+    Map loaded;
+    loaded.emplace(uint64_t{1}, uint64_t{1});
+    loaded.load(stream);
+    CHECK(loaded.size() == map.size());
+    for (uint64_t key = 0; key < 100000; ++key) {
+        CHECK(loaded.at(key * 7) == key);
+    }
+    CHECK(loaded.count(1) == 0);
+    std::string trailer;
+    stream >> trailer;
+    CHECK(trailer == "trailer");
+}
+
+// The header is well-formed and claims 2^28 elements, 4 GiB, but the stream ends a few elements later.
+void TestForgedCount() {
+    SnapshotHeader header = SnapshotHeader::Make<uint64_t, uint64_t>(uint64_t{1} << 28);
+    std::string snapshot(reinterpret_cast<const char*>(&header), sizeof(header));
+    snapshot.resize(header.elements_offset + 10 * header.element_size);
+    std::istringstream stream(snapshot);
+    Map map;
+    map.emplace(uint64_t{1}, uint64_t{1});
+    largest_allocation = 0;
+    bool thrown = false;
+    try {
+        map.load(stream);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(map.empty());
+    CHECK(largest_allocation <= (size_t{4} << 20));
+}
+
+}  // namespace
+
+int main() {
+    TestRoundTrip();
+    TestForgedCount();
+}